@@ -27,8 +27,14 @@
 
 #pragma once
 
-#define EEMEM
+#include <stdint.h>
+
+// EEPROM vars live in their own section so the emulator can persist them
+#define EEMEM __attribute__((section("eeprom")))
 
 #define eeprom_update_word(PTR, VAL) *(PTR) = (VAL)
 #define eeprom_read_word(PTR) *(PTR)
+#define eeprom_read_byte(PTR) *(PTR)
 #define eeprom_is_ready() true
+
+void eeprom_update_byte(uint8_t *ptr, uint8_t value);
@@ -36,6 +36,9 @@
 #define puts_P puts
 #define sprintf_P sprintf
 #define strcmp_P strcmp
+#define strlen_P strlen
+#define strcpy_P strcpy
+#define memcpy_P memcpy
 #define pgm_read_ptr(x) *(x)
 #define pgm_read_word(x) *(x)
 #define pgm_read_byte(x) *(x)
@@ -25,7 +25,12 @@
 
 \******************************************************************************/
 
+#include "vfd_slave.h"
+#include "index_sim.h"
+
 #include <config.h>
+#include <vars.h>
+#include <util.h>
 
 #include <avr/io.h>
 
@@ -42,16 +47,13 @@ void __SPIC_INT_vect();      // DRV8711 SPI
 void __I2C_ISR();            // I2C from RPi
 void __ADCA_CH0_vect();      // Analog input
 void __ADCA_CH1_vect();      // Analog input
-void __RS485_DRE_vect();     // RS848
-void __RS485_TXC_vect();     // RS848
-void __RS485_RXC_vect();     // RS848
 void __SERIAL_DRE_vect();    // Serial to RPi
 void __SERIAL_RXC_vect();    // Serial from RPi
 void __STEP_LOW_LEVEL_ISR(); // Stepper lo interrupt
 void __STEP_TIMER_ISR();     // Stepper hi interrupt
 void __RTC_OVF_vect();       // RTC tick
 
-void motor_emulate_steps(int motor);
+uint16_t motor_emulate_steps(int motor, uint16_t lost);
 
 extern int __argc;
 extern char **__argv;
@@ -61,21 +63,75 @@ volatile uint8_t io_mem[4096] = {0};
 
 
 bool fast = false;
+bool benchVars = false;
+bool testFloat = false;
+bool benchVFD = false;
+uint16_t stepLoss[4] = {0}; // Step pulses to drop, per motor
 int serialByte = -1;
 uint8_t i2cData[I2C_MAX_DATA];
 int i2cIndex = 0;
 bool haveI2C = false;
 fd_set readFDs;
+int eepromFD = -1;
+
+
+// Section bounds of the EEMEM vars
+extern uint8_t __start_eeprom[];
+extern uint8_t __stop_eeprom[];
 
 
 void cli() {}
 void sei() {}
 
 
+void eeprom_update_byte(uint8_t *ptr, uint8_t value) {
+  *ptr = value;
+  if (eepromFD != -1 && pwrite(eepromFD, ptr, 1, ptr - __start_eeprom) != 1)
+    perror("EEPROM write");
+}
+
+
+static void _eeprom_open(const char *path) {
+  // Persist EEPROM in a file, unwritten bytes read as erased
+  memset(__start_eeprom, 0xff, __stop_eeprom - __start_eeprom);
+  eepromFD = open(path, O_RDWR | O_CREAT, 0644);
+  if (eepromFD == -1) perror(path);
+  else if (read(eepromFD, __start_eeprom, __stop_eeprom - __start_eeprom) < 0)
+    perror(path);
+}
+
+
 void emu_init() {
   // Parse command line args
   for (int i = 0; i < __argc; i++)
     if (strcmp(__argv[i], "--fast") == 0) fast = true;
+    else if (strcmp(__argv[i], "--bench-vars") == 0) benchVars = true;
+    else if (strcmp(__argv[i], "--test-float") == 0) testFloat = true;
+    else if (strcmp(__argv[i], "--bench-vfd") == 0) benchVFD = true;
+    else if (strcmp(__argv[i], "--eeprom") == 0 && i + 1 < __argc)
+      _eeprom_open(__argv[++i]);
+    else if (strcmp(__argv[i], "--vfd") == 0 && i + 1 < __argc) {
+      if (!vfd_slave_set_model(__argv[++i])) exit(1);
+    } else if (strcmp(__argv[i], "--vfd-id") == 0 && i + 1 < __argc)
+      vfd_slave_set_id(atoi(__argv[++i]));
+    else if (strcmp(__argv[i], "--vfd-delay") == 0 && i + 1 < __argc)
+      vfd_slave_set_delay(atof(__argv[++i]));
+    else if (strcmp(__argv[i], "--vfd-ramp") == 0 && i + 1 < __argc)
+      vfd_slave_set_ramp(atof(__argv[++i]));
+    else if (strcmp(__argv[i], "--vfd-crc") == 0 && i + 1 < __argc)
+      vfd_slave_set_crc_errors(atoi(__argv[++i]));
+    else if (strcmp(__argv[i], "--vfd-drop") == 0 && i + 1 < __argc)
+      vfd_slave_set_drops(atoi(__argv[++i]));
+    else if (strcmp(__argv[i], "--bench-baud") == 0 && i + 1 < __argc)
+      vfd_slave_set_bench_baud(atoi(__argv[++i]));
+    else if (strcmp(__argv[i], "--index-rpm") == 0 && i + 1 < __argc)
+      index_sim_set_rpm(atof(__argv[++i]));
+    else if (strcmp(__argv[i], "--index-wobble") == 0 && i + 1 < __argc)
+      index_sim_set_wobble(atof(__argv[++i]));
+    else if (strcmp(__argv[i], "--step-loss") == 0 && i + 1 < __argc) {
+      uint16_t lost = atoi(__argv[++i]);
+      for (int motor = 0; motor < 4; motor++) stepLoss[motor] = lost;
+    }
 
   // Mark clocks ready
   OSC.STATUS = OSC_XOSCRDY_bm | OSC_PLLRDY_bm | OSC_RC32KRDY_bm;
@@ -91,6 +147,18 @@ void emu_init() {
 
 
 void emu_callback() {
+  if (benchVars) {
+    vars_benchmark();
+    exit(0);
+  }
+
+  if (testFloat) {
+    format_float_test();
+    exit(0);
+  }
+
+  if (benchVFD) vfd_slave_benchmark();
+
   fflush(stdout);
 
   if (RST.CTRL == RST_SWRST_bm) exit(0);
@@ -152,9 +220,16 @@ void emu_callback() {
 
   // Call stepper ISRs
   if (ADCB_CH0_INTCTRL == ADC_CH_INTLVL_LO_gc) __STEP_LOW_LEVEL_ISR();
-  for (int motor = 0; motor < 4; motor++) motor_emulate_steps(motor);
+  for (int motor = 0; motor < 4; motor++)
+    stepLoss[motor] -= motor_emulate_steps(motor, stepLoss[motor]);
   __STEP_TIMER_ISR();
 
+  // RS485 bus and VFD
+  vfd_slave_callback();
+
+  // Spindle index sensor
+  index_sim_callback();
+
   // Call RTC
   __RTC_OVF_vect();
 
@@ -0,0 +1,83 @@
+/******************************************************************************\
+
+                  This file is part of the Buildbotics firmware.
+
+         Copyright (c) 2015 - 2021, Buildbotics LLC, All rights reserved.
+
+          This Source describes Open Hardware and is licensed under the
+                                  CERN-OHL-S v2.
+
+          You may redistribute and modify this Source and make products
+     using it under the terms of the CERN-OHL-S v2 (https:/cern.ch/cern-ohl).
+            This Source is distributed WITHOUT ANY EXPRESS OR IMPLIED
+     WARRANTY, INCLUDING OF MERCHANTABILITY, SATISFACTORY QUALITY AND FITNESS
+      FOR A PARTICULAR PURPOSE. Please see the CERN-OHL-S v2 for applicable
+                                   conditions.
+
+                 Source location: https://github.com/buildbotics
+
+       As per CERN-OHL-S v2 section 4, should You produce hardware based on
+     these sources, You must maintain the Source Location clearly visible on
+     the external case of the CNC Controller or other product you make using
+                                   this Source.
+
+                 For more information, email info@buildbotics.com
+
+\******************************************************************************/
+
+#include "index_sim.h"
+
+#include <config.h>
+#include <pins.h>
+#include <rtc.h>
+
+#include <avr/io.h>
+
+#include <math.h>
+
+
+/*
+  Emulated spindle index sensor.
+
+  The spindle turns at the configured speed, optionally wobbling
+  sinusoidally once a second to exercise speed tracking.  On each revolution
+  the index pin change interrupt is raised with the RTC count set to where in
+  the current tick the pulse fell, as the hardware would timestamp it.
+*/
+
+
+void __SPINDLE_INDEX_ISR_vect();
+
+
+static struct {
+  float rpm;
+  float wobble; // Fraction of rpm
+  double revs;
+  uint32_t ms;
+} sim;
+
+
+void index_sim_set_rpm(float rpm) {sim.rpm = rpm;}
+void index_sim_set_wobble(float percent) {sim.wobble = percent / 100;}
+
+
+void index_sim_callback() {
+  if (!sim.rpm) return;
+
+  double wobble = sim.wobble * sin(2 * M_PI * sim.ms++ / 1000);
+  double rate = sim.rpm * (1 + wobble) / 60000; // revs per ms
+  double next = sim.revs + rate;
+
+  if (floor(sim.revs) < floor(next)) {
+    PORT_t *port = PIN_PORT(SPINDLE_INDEX_PIN);
+
+    if ((port->INT0MASK & PIN_BM(SPINDLE_INDEX_PIN)) &&
+        (port->INTCTRL & PORT_INT0LVL_gm)) {
+      RTC.CNT = (floor(next) - sim.revs) / rate * RTC_PERIOD;
+      __SPINDLE_INDEX_ISR_vect();
+      RTC.CNT = 0;
+    }
+  }
+
+  sim.revs = next;
+}
@@ -0,0 +1,764 @@
+/******************************************************************************\
+
+                  This file is part of the Buildbotics firmware.
+
+         Copyright (c) 2015 - 2021, Buildbotics LLC, All rights reserved.
+
+          This Source describes Open Hardware and is licensed under the
+                                  CERN-OHL-S v2.
+
+          You may redistribute and modify this Source and make products
+     using it under the terms of the CERN-OHL-S v2 (https:/cern.ch/cern-ohl).
+            This Source is distributed WITHOUT ANY EXPRESS OR IMPLIED
+     WARRANTY, INCLUDING OF MERCHANTABILITY, SATISFACTORY QUALITY AND FITNESS
+      FOR A PARTICULAR PURPOSE. Please see the CERN-OHL-S v2 for applicable
+                                   conditions.
+
+                 Source location: https://github.com/buildbotics
+
+       As per CERN-OHL-S v2 section 4, should You produce hardware based on
+     these sources, You must maintain the Source Location clearly visible on
+     the external case of the CNC Controller or other product you make using
+                                   this Source.
+
+                 For more information, email info@buildbotics.com
+
+\******************************************************************************/
+
+
+#include "vfd_slave.h"
+
+#include <config.h>
+#include <usart.h>
+#include <vars.h>
+#include <spindle.h>
+
+#include <avr/io.h>
+#include <util/crc16.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+
+/*
+  Emulated VFD on the RS485 bus.
+
+  The bus is clocked in simulated time, one emulator tick per millisecond.
+  Bytes leave and arrive at the configured baud rate and the frame timer
+  counts in between them so frame detection, retries and timeouts behave as
+  they would on the wire.  The slave answers a request 3.5 characters after
+  its last byte plus the configured delay.  Without a model the bus is silent,
+  like a disconnected drive.
+
+  Register maps follow the tables in vfd_spindle.c.  Frequencies are in the
+  drive's own units, 0.1Hz with a 400Hz maximum or 0.01Hz for Huanyang.
+  Status registers read bit 0 running, bit 1 reverse and bit 2 at speed.
+*/
+
+
+void __RS485_DRE_vect();
+void __RS485_TXC_vect();
+void __RS485_RXC_vect();
+void __RS485_TIMER_CCA_vect();
+void __RS485_TIMER_OVF_vect();
+
+void command_speed_exec(void *data);
+uint8_t get_mb_baud();
+uint16_t get_mb_crc_errs();
+
+
+typedef enum {
+  ROLE_NONE,
+  ROLE_PARAM,     // Reads back what was last written
+  ROLE_MAX_FREQ,
+  ROLE_FREQ_SET,
+  ROLE_CONTROL,   // Run, stop and direction
+  ROLE_FREQ_READ, // Output frequency
+  ROLE_STATUS,
+} role_t;
+
+
+typedef struct {
+  role_t role;
+  uint16_t addr;
+  uint16_t value;
+} slave_reg_t;
+
+
+typedef void (*control_cb_t)(uint16_t value);
+
+
+typedef struct {
+  const char *name;
+  spindle_type_t type;
+  control_cb_t control; // Null for the Huanyang protocol
+  const slave_reg_t *regs;
+} model_t;
+
+
+#define SLAVE_REGS 16
+#define SLAVE_BUF_SIZE 64
+
+
+static struct {
+  const model_t *model;
+  uint8_t id;
+  float delay;       // ms from end of request to start of response
+  float ramp;        // ms from stopped to max frequency
+  unsigned crc_every;
+  unsigned drop_every;
+
+  slave_reg_t regs[SLAVE_REGS];
+  bool running;
+  bool reverse;
+  uint16_t target;
+  float actual;      // Signed output frequency
+  uint16_t max_freq;
+
+  double now;        // ms
+  double timer_time; // Frame timer has been run up to this time
+  double tx_free;    // Line free for the next transmitted byte
+  double request_end;
+  uint8_t request[SLAVE_BUF_SIZE];
+  uint8_t request_length;
+  double response_start;
+  uint8_t response[SLAVE_BUF_SIZE];
+  uint8_t response_length;
+  uint8_t response_sent;
+  bool response_write;
+  bool response_poll;
+  bool response_corrupt;
+
+  unsigned requests;
+  unsigned responses;
+  unsigned polls;
+  unsigned crc_errors;
+  unsigned drops;
+} slave = {0, 1, 5};
+
+
+static struct {
+  unsigned baud;
+  unsigned step;
+  bool waiting;
+  bool acked;
+  float power;
+  double start;  // Speed command or start of hold
+  double ack;
+
+  unsigned changes;
+  unsigned missed;
+  double latency_min;
+  double latency_max;
+  double latency_total;
+  unsigned polls;
+  double poll_time;
+} bench;
+
+
+// Bits of the Huanyang control write, see modbus.h and huanyang_regs
+enum {
+  HY_RUN     = 1 << 0,
+  HY_FORWARD = 1 << 1,
+  HY_REVERSE = 1 << 2,
+  HY_STOP    = 1 << 3,
+  HY_REV_FWD = 1 << 4,
+};
+
+
+static void _ac_tech_control(uint16_t value) {
+  if (value & 128) slave.reverse = false;
+  if (value & 64) slave.reverse = true;
+  if (value & 8) slave.running = true;
+  if (value & 4) slave.running = false;
+}
+
+
+static void _nowforever_control(uint16_t value) {
+  slave.running = value & 1;
+  if (slave.running) slave.reverse = value & 2;
+}
+
+
+// Delta and YL600
+static void _delta_control(uint16_t value) {
+  if (value & 0x10) slave.reverse = false;
+  if (value & 0x20) slave.reverse = true;
+  if (value & 2) slave.running = true;
+  if (value & 1) slave.running = false;
+}
+
+
+static void _huanyang_control(uint16_t value) {
+  if (value & (HY_REVERSE | HY_REV_FWD)) slave.reverse = true;
+  else if (value & HY_FORWARD) slave.reverse = false;
+  if (value & HY_RUN) slave.running = true;
+  if (value & HY_STOP) slave.running = false;
+}
+
+
+static const slave_reg_t ac_tech_regs[] = {
+  {ROLE_CONTROL,    1,    0}, // Also unlock and lock bits
+  {ROLE_PARAM,     24,    0}, // Status block
+  {ROLE_FREQ_READ, 25,    0}, // Actual freq
+  {ROLE_PARAM,     26,    0},
+  {ROLE_PARAM,     27,    0},
+  {ROLE_PARAM,     28,    0},
+  {ROLE_PARAM,     29,    0},
+  {ROLE_FREQ_SET,  40,    0},
+  {ROLE_PARAM,     48,    0}, // Password
+  {ROLE_MAX_FREQ,  62, 4000},
+  {ROLE_NONE},
+};
+
+
+static const slave_reg_t nowforever_regs[] = {
+  {ROLE_MAX_FREQ,     7, 4000},
+  {ROLE_STATUS,     768,    0},
+  {ROLE_FREQ_READ, 1282,    0},
+  {ROLE_CONTROL,   2304,    0},
+  {ROLE_FREQ_SET,  2305,    0},
+  {ROLE_NONE},
+};
+
+
+static const slave_reg_t delta_vfd015m21a_regs[] = {
+  {ROLE_MAX_FREQ,       3, 4000},
+  {ROLE_CONTROL,   0x2000,    0},
+  {ROLE_FREQ_SET,  0x2001,    0},
+  {ROLE_PARAM,     0x2002,    0}, // Reset fault
+  {ROLE_STATUS,    0x2100,    0},
+  {ROLE_FREQ_READ, 0x2103,    0},
+  {ROLE_NONE},
+};
+
+
+static const slave_reg_t yl600_regs[] = {
+  {ROLE_MAX_FREQ,  0x0004, 4000},
+  {ROLE_CONTROL,   0x2000,    0},
+  {ROLE_FREQ_SET,  0x2001,    0},
+  {ROLE_STATUS,    0x2008,    0},
+  {ROLE_FREQ_READ, 0x200b,    0},
+  {ROLE_NONE},
+};
+
+
+// Function codes, addresses are PD parameter numbers
+static const slave_reg_t huanyang_regs[] = {
+  {ROLE_MAX_FREQ,    5, 40000}, // PD005 Max frequency
+  {ROLE_PARAM,      11, 12000}, // PD011 Frequency lower limit
+  {ROLE_PARAM,     144, 24000}, // PD144 Rated motor RPM
+  {ROLE_NONE},
+};
+
+
+static const model_t models[] = {
+  {"ac-tech",    SPINDLE_TYPE_AC_TECH,    _ac_tech_control,    ac_tech_regs},
+  {"nowforever", SPINDLE_TYPE_NOWFOREVER, _nowforever_control,
+   nowforever_regs},
+  {"delta", SPINDLE_TYPE_DELTA_VFD015M21A, _delta_control,
+   delta_vfd015m21a_regs},
+  {"yl600",      SPINDLE_TYPE_YL600,      _delta_control,      yl600_regs},
+  {"huanyang",   SPINDLE_TYPE_HUANYANG,   0,                   huanyang_regs},
+  {0},
+};
+
+
+static slave_reg_t *_find(uint16_t addr) {
+  for (int i = 0; i < SLAVE_REGS && slave.regs[i].role; i++)
+    if (slave.regs[i].addr == addr) return &slave.regs[i];
+
+  return 0;
+}
+
+
+static bool _at_speed() {
+  float target = slave.running ? slave.target : 0;
+  return fabs(fabs(slave.actual) - target) < 1 &&
+    (!slave.actual || (slave.actual < 0) == slave.reverse);
+}
+
+
+static uint16_t _status() {
+  return slave.running | slave.reverse << 1 | _at_speed() << 2;
+}
+
+
+static uint16_t _read(const slave_reg_t &reg) {
+  switch (reg.role) {
+  case ROLE_FREQ_READ: return fabs(slave.actual) + 0.5;
+  case ROLE_STATUS: return _status();
+  default: return reg.value;
+  }
+}
+
+
+static void _write(slave_reg_t &reg, uint16_t value) {
+  reg.value = value;
+
+  switch (reg.role) {
+  case ROLE_MAX_FREQ: slave.max_freq = value; break;
+  case ROLE_FREQ_SET: slave.target = value; break;
+  case ROLE_CONTROL: slave.model->control(value); break;
+  default: break;
+  }
+}
+
+
+static uint16_t _word(const uint8_t *data) {return data[0] << 8 | data[1];}
+static void _put(uint8_t data) {slave.response[slave.response_length++] = data;}
+
+
+static void _put_word(uint16_t value) {
+  _put(value >> 8);
+  _put(value);
+}
+
+
+static void _exception(uint8_t code) {
+  slave.response[1] |= 0x80;
+  slave.response_length = 2;
+  _put(code);
+}
+
+
+static void _modbus_request(const uint8_t *req, uint8_t length) {
+  uint16_t addr = _word(req + 2);
+  uint16_t count = _word(req + 4);
+
+  switch (req[1]) {
+  case 3: case 4: // Read registers
+    if (length != 6 || !count || 125 < count) return _exception(3);
+    for (unsigned i = 0; i < count; i++)
+      if (!_find(addr + i)) return _exception(2);
+
+    _put(2 * count);
+    for (unsigned i = 0; i < count; i++) _put_word(_read(*_find(addr + i)));
+    slave.response_poll = true;
+    break;
+
+  case 6: { // Write register
+    if (length != 6) return _exception(3);
+    slave_reg_t *reg = _find(addr);
+    if (!reg) return _exception(2);
+
+    _write(*reg, count);
+    _put_word(addr);
+    _put_word(count);
+    slave.response_write = true;
+    break;
+  }
+
+  case 16: // Write registers
+    if (length < 7 || !count || length != 7 + 2 * count || req[6] != 2 * count)
+      return _exception(3);
+    for (unsigned i = 0; i < count; i++)
+      if (!_find(addr + i)) return _exception(2);
+
+    for (unsigned i = 0; i < count; i++)
+      _write(*_find(addr + i), _word(req + 7 + 2 * i));
+    _put_word(addr);
+    _put_word(count);
+    slave.response_write = true;
+    break;
+
+  default: return _exception(1);
+  }
+}
+
+
+static uint16_t _huanyang_ctrl_read(uint8_t addr) {
+  float freq = fabs(slave.actual);
+
+  switch (addr) {
+  case 0: return slave.target;                             // Target freq
+  case 1: return freq + 0.5;                               // Actual freq
+  case 2: return freq ? 250 : 0;                           // Current, 0.01A
+  case 3: return freq / slave.max_freq * _find(144)->value; // RPM
+  case 4: return 3100;                                     // DC volts, 0.1V
+  case 5: return 2200;                                     // AC volts, 0.1V
+  case 7: return 35;                                       // Temperature
+  default: return 0;
+  }
+}
+
+
+// Huanyang messages are [id][func][length][data][crc], see modbus.h
+static void _huanyang_request(const uint8_t *req, uint8_t length) {
+  const uint8_t *data = req + 3;
+  if (length < 3 || length != req[2] + 3) return; // No exceptions, ignored
+
+  switch (req[1]) {
+  case 1: { // Function read
+    slave_reg_t *reg = _find(data[0]);
+    if (req[2] != 1 || !reg) return;
+    _put(3);
+    _put(data[0]);
+    _put_word(reg->value);
+    slave.response_poll = true;
+    break;
+  }
+
+  case 2: { // Function write
+    slave_reg_t *reg = _find(data[0]);
+    if (req[2] != 3 || !reg) return;
+    _write(*reg, _word(data + 1));
+    for (unsigned i = 0; i < 4; i++) _put(req[2 + i]);
+    slave.response_write = true;
+    break;
+  }
+
+  case 3: // Control write
+    if (req[2] != 1) return;
+    _huanyang_control(data[0]);
+    _put(1);
+    _put(slave.running | slave.reverse << 2 | (slave.actual != 0) << 3);
+    slave.response_write = true;
+    break;
+
+  case 4: // Control read
+    if (req[2] != 1) return;
+    _put(3);
+    _put(data[0]);
+    _put_word(_huanyang_ctrl_read(data[0]));
+    slave.response_poll = true;
+    break;
+
+  case 5: // Frequency write
+    if (req[2] != 2) return;
+    slave.target = _word(data);
+    for (unsigned i = 0; i < 3; i++) _put(req[2 + i]);
+    slave.response_write = true;
+    break;
+
+  default: return;
+  }
+}
+
+
+static uint16_t _crc16(const uint8_t *buffer, unsigned length) {
+  uint16_t crc = 0xffff;
+
+  for (unsigned i = 0; i < length; i++)
+    crc = _crc16_update(crc, buffer[i]);
+
+  return crc;
+}
+
+
+static double _char_time() {
+  return 11000.0 / usart_get_bps((baud_t)get_mb_baud()); // ms
+}
+
+
+static void _request() {
+  uint8_t length = slave.request_length;
+  slave.request_length = 0;
+
+  // Bad frames and requests for other slaves get no response, the CRC is
+  // sent low byte first
+  if (!slave.model || length < 4 || slave.request[0] != slave.id) return;
+  length -= 2;
+  uint16_t crc = slave.request[length] | slave.request[length + 1] << 8;
+  if (_crc16(slave.request, length) != crc) return;
+
+  if (slave.drop_every && ++slave.requests % slave.drop_every == 0) {
+    slave.drops++;
+    return;
+  }
+
+  slave.response_length = slave.response_sent = 0;
+  slave.response_write = slave.response_poll = false;
+  _put(slave.request[0]);
+  _put(slave.request[1]);
+
+  if (slave.model->control) _modbus_request(slave.request, length);
+  else _huanyang_request(slave.request, length);
+
+  if (slave.response_length < 3) {
+    slave.response_length = 0;
+    return;
+  }
+
+  crc = _crc16(slave.response, slave.response_length);
+  _put(crc);
+  _put(crc >> 8);
+
+  slave.response_corrupt =
+    slave.crc_every && ++slave.responses % slave.crc_every == 0;
+  if (slave.response_corrupt) {
+    slave.response[slave.response_length - 1] ^= 0xff;
+    slave.crc_errors++;
+  }
+
+  slave.response_start = slave.request_end + 3.5 * _char_time() + slave.delay;
+}
+
+
+static unsigned _timer_div() {
+  switch (RS485_TIMER.CTRLA & TC1_CLKSEL_gm) {
+  case TC_CLKSEL_DIV1_gc:    return 1;
+  case TC_CLKSEL_DIV2_gc:    return 2;
+  case TC_CLKSEL_DIV4_gc:    return 4;
+  case TC_CLKSEL_DIV8_gc:    return 8;
+  case TC_CLKSEL_DIV64_gc:   return 64;
+  case TC_CLKSEL_DIV256_gc:  return 256;
+  case TC_CLKSEL_DIV1024_gc: return 1024;
+  default: return 0; // Off or event clocked
+  }
+}
+
+
+/// Run the frame timer up to time t
+static void _timer_run(double t) {
+  double elapsed = t - slave.timer_time;
+  slave.timer_time = t;
+
+  unsigned div = _timer_div();
+  if (!div) return;
+
+  uint32_t cnt = RS485_TIMER.CNT;
+  uint32_t next = cnt + (uint32_t)(elapsed * (F_CPU / 1000) / div);
+  uint16_t cca = RS485_TIMER.CCA;
+  uint16_t per = RS485_TIMER.PER;
+
+  if (cnt < cca && cca <= next && (RS485_TIMER.INTCTRLB & TC1_CCAINTLVL_gm))
+    __RS485_TIMER_CCA_vect();
+
+  if (next <= per) RS485_TIMER.CNT = next;
+  else {
+    RS485_TIMER.CNT = (next - per - 1) % (per + 1);
+    if (RS485_TIMER.INTCTRLA & TC1_OVFINTLVL_gm) __RS485_TIMER_OVF_vect();
+  }
+}
+
+
+static void _transmit(double end) {
+  double char_time = _char_time();
+
+  while (RS485_PORT.CTRLA & USART_DREINTLVL_gm) {
+    double t = slave.tx_free < slave.now ? slave.now : slave.tx_free;
+    if (end <= t) break;
+
+    // A gap of more than 1.5 characters starts a new frame
+    if (slave.request_end + 1.5 * char_time < t) slave.request_length = 0;
+
+    __RS485_DRE_vect();
+    if (slave.request_length < SLAVE_BUF_SIZE)
+      slave.request[slave.request_length++] = RS485_PORT.DATA;
+    slave.tx_free = slave.request_end = t + char_time;
+  }
+
+  bool sending = RS485_PORT.CTRLA & USART_DREINTLVL_gm;
+  if (!sending && (RS485_PORT.CTRLA & USART_TXCINTLVL_gm) &&
+      slave.tx_free <= end) __RS485_TXC_vect();
+
+  // The slave sees the end of a request after 3.5 characters of silence
+  if (!sending && slave.request_length &&
+      slave.request_end + 3.5 * char_time <= end) _request();
+}
+
+
+static bool _applied() {
+  if (slave.running != (bench.power != 0)) return false;
+  if (!slave.running) return true;
+  if (slave.reverse != (bench.power < 0)) return false;
+  return fabs(slave.target - fabs(bench.power) * slave.max_freq) <= 1;
+}
+
+
+static void _response_sent(double t) {
+  if (slave.response_corrupt) return;
+  if (slave.response_poll) slave.polls++;
+
+  // Acknowledged when the controller sees the end of the response
+  if (bench.waiting && slave.response_write && _applied()) {
+    bench.waiting = false;
+    bench.acked = true;
+    bench.ack = t + 3.5 * _char_time();
+  }
+}
+
+
+static void _receive(double end) {
+  double char_time = _char_time();
+
+  while (slave.response_sent < slave.response_length) {
+    double t = slave.response_start + (slave.response_sent + 1) * char_time;
+    if (end <= t) break;
+
+    _timer_run(t);
+
+    uint8_t data = slave.response[slave.response_sent++];
+    if (RS485_PORT.CTRLA & USART_RXCINTLVL_gm) {
+      RS485_PORT.DATA = data;
+      __RS485_RXC_vect();
+    }
+
+    if (slave.response_sent == slave.response_length) _response_sent(t);
+  }
+
+  _timer_run(end);
+}
+
+
+static void _drive() {
+  float target = slave.running ? slave.target : 0;
+  if (slave.reverse) target = -target;
+
+  float step = slave.ramp ? slave.max_freq / slave.ramp : INFINITY;
+  if (fabs(target - slave.actual) <= step) slave.actual = target;
+  else slave.actual += target < slave.actual ? -step : step;
+}
+
+
+bool vfd_slave_set_model(const char *name) {
+  for (int i = 0; models[i].name; i++)
+    if (!strcmp(models[i].name, name)) {
+      slave.model = &models[i];
+
+      memset(slave.regs, 0, sizeof(slave.regs));
+      for (int j = 0; j < SLAVE_REGS && models[i].regs[j].role; j++) {
+        slave.regs[j] = models[i].regs[j];
+        if (slave.regs[j].role == ROLE_MAX_FREQ)
+          slave.max_freq = slave.regs[j].value;
+      }
+
+      return true;
+    }
+
+  fprintf(stderr, "Unknown VFD '%s', one of:", name);
+  for (int i = 0; models[i].name; i++) fprintf(stderr, " %s", models[i].name);
+  fprintf(stderr, "\n");
+
+  return false;
+}
+
+
+void vfd_slave_set_id(unsigned id) {slave.id = id;}
+void vfd_slave_set_delay(float ms) {slave.delay = ms;}
+void vfd_slave_set_ramp(float ms) {slave.ramp = ms;}
+void vfd_slave_set_crc_errors(unsigned every) {slave.crc_every = every;}
+void vfd_slave_set_drops(unsigned every) {slave.drop_every = every;}
+void vfd_slave_set_bench_baud(unsigned bps) {bench.baud = bps;}
+
+
+void vfd_slave_callback() {
+  double end = slave.now + 1;
+
+  _transmit(end);
+  _receive(end);
+  _drive();
+
+  slave.now = end;
+}
+
+
+// Benchmark speeds in RPM with the maximum at 24000
+static const float bench_speeds[] = {
+  6000, 12000, 24000, -12000, 0, 18000, -24000, 3000, 0,
+};
+
+#define BENCH_CHANGES 36
+#define BENCH_SETTLE 1000  // ms to connect before the first change
+#define BENCH_HOLD 500     // ms of polling between changes
+#define BENCH_TIMEOUT 2000 // ms to wait for a change to be acknowledged
+
+
+static void _bench_report() {
+  unsigned acked = bench.changes - bench.missed;
+
+  printf("VFD %s at %u baud, %.1fms delay, %u changes: speed to ack "
+         "min %.1fms avg %.1fms max %.1fms, %u missed, %.1f polls/s, "
+         "%u CRC errors, %u dropped, %u controller CRC errors\n",
+         slave.model->name, usart_get_bps((baud_t)get_mb_baud()), slave.delay,
+         bench.changes, bench.latency_min,
+         acked ? bench.latency_total / acked : 0, bench.latency_max,
+         bench.missed, bench.polls * 1000 / bench.poll_time,
+         slave.crc_errors, slave.drops, get_mb_crc_errs());
+}
+
+
+static void _bench_speed() {
+  float speed = bench_speeds[bench.changes++ % (sizeof(bench_speeds) /
+                                                sizeof(float))];
+  bench.power = speed / 24000;
+  bench.waiting = true;
+  bench.acked = false;
+  bench.start = slave.now;
+
+  command_speed_exec(&speed);
+}
+
+
+void vfd_slave_benchmark() {
+  if (!slave.model) {
+    fprintf(stderr, "--bench-vfd requires --vfd <model>\n");
+    exit(1);
+  }
+
+  switch (bench.step) {
+  case 0: { // Configure the controller for the drive
+    char value[16];
+
+    if (bench.baud)
+      for (int baud = USART_BAUD_9600; baud <= USART_BAUD_1000000; baud++)
+        if (usart_get_bps((baud_t)baud) == bench.baud) {
+          sprintf(value, "%d", baud);
+          vars_set("mb", value);
+        }
+
+    sprintf(value, "%d", slave.id);
+    vars_set("hi", value);
+    vars_set("sx", "24000");
+    sprintf(value, "%d", slave.model->type);
+    vars_set("st", value);
+
+    bench.latency_min = INFINITY;
+    bench.start = slave.now;
+    bench.step++;
+    break;
+  }
+
+  case 1: // Connect
+    if (slave.now < bench.start + BENCH_SETTLE) break;
+    _bench_speed();
+    bench.step++;
+    break;
+
+  case 2: // Wait for the speed change to be acknowledged
+    if (bench.acked) {
+      double latency = bench.ack - bench.start;
+      if (latency < bench.latency_min) bench.latency_min = latency;
+      if (bench.latency_max < latency) bench.latency_max = latency;
+      bench.latency_total += latency;
+
+    } else if (slave.now < bench.start + BENCH_TIMEOUT) break;
+    else {
+      bench.waiting = false;
+      bench.missed++;
+    }
+
+    bench.start = slave.now;
+    bench.polls -= slave.polls;
+    bench.step++;
+    break;
+
+  case 3: // Count polls at a steady speed
+    if (slave.now < bench.start + BENCH_HOLD) break;
+    bench.polls += slave.polls;
+    bench.poll_time += BENCH_HOLD;
+
+    if (bench.changes == BENCH_CHANGES) {
+      _bench_report();
+      exit(0);
+    }
+
+    _bench_speed();
+    bench.step = 2;
+    break;
+  }
+}
@@ -0,0 +1,42 @@
+/******************************************************************************\
+
+                  This file is part of the Buildbotics firmware.
+
+         Copyright (c) 2015 - 2021, Buildbotics LLC, All rights reserved.
+
+          This Source describes Open Hardware and is licensed under the
+                                  CERN-OHL-S v2.
+
+          You may redistribute and modify this Source and make products
+     using it under the terms of the CERN-OHL-S v2 (https:/cern.ch/cern-ohl).
+            This Source is distributed WITHOUT ANY EXPRESS OR IMPLIED
+     WARRANTY, INCLUDING OF MERCHANTABILITY, SATISFACTORY QUALITY AND FITNESS
+      FOR A PARTICULAR PURPOSE. Please see the CERN-OHL-S v2 for applicable
+                                   conditions.
+
+                 Source location: https://github.com/buildbotics
+
+       As per CERN-OHL-S v2 section 4, should You produce hardware based on
+     these sources, You must maintain the Source Location clearly visible on
+     the external case of the CNC Controller or other product you make using
+                                   this Source.
+
+                 For more information, email info@buildbotics.com
+
+\******************************************************************************/
+
+
+#pragma once
+
+#include <stdbool.h>
+
+
+bool vfd_slave_set_model(const char *name);
+void vfd_slave_set_id(unsigned id);
+void vfd_slave_set_delay(float ms);
+void vfd_slave_set_ramp(float ms);
+void vfd_slave_set_crc_errors(unsigned every);
+void vfd_slave_set_drops(unsigned every);
+void vfd_slave_set_bench_baud(unsigned bps);
+void vfd_slave_callback();
+void vfd_slave_benchmark();
@@ -149,3 +149,20 @@ bool b64_decode_float(const char *s, float *f) {
 
   return true;
 }
+
+
+// Decodes a big-endian, sign-extended integer of @param len * 6 bits
+bool b64_decode_int(const char *s, unsigned len, int32_t *x) {
+  int32_t v = 0;
+
+  for (unsigned i = 0; i < len; i++) {
+    int8_t d = _decode(s[i]);
+    if (d < 0) return false;
+    v = v << 6 | d;
+  }
+
+  int32_t sign = (int32_t)1 << (len * 6 - 1);
+  *x = (v ^ sign) - sign;
+
+  return true;
+}
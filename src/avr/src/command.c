@@ -39,6 +39,8 @@
 #include "base64.h"
 #include "rtc.h"
 #include "stepper.h"
+#include "line.h"
+#include "spindle.h"
 #include "cpp_magic.h"
 
 #include <util/atomic.h>
@@ -59,10 +61,18 @@
 
 static struct {
   bool active;
-  uint16_t id;
+  uint16_t id;            // ID of the last executed command
+  uint16_t next_id;       // ID of the last dequeued command
+  uint16_t queue_id;      // ID given to newly queued commands
   uint32_t last_empty;
   volatile uint16_t count;
   float position[AXES];
+
+  bool credit;            // Credit based flow control enabled
+  uint16_t credit_start;  // RX count when credits were reset
+  uint16_t credit_count;  // RX count at last credit update
+
+  uint16_t lines_peak;    // Most lines processed in one callback
 } cmd = {0,};
 
 
@@ -116,6 +126,10 @@ static unsigned _size(char code) {
 }
 
 
+// Queued commands are a code byte, a 16-bit command ID and the command data
+static unsigned _queued_size(char code) {return 3 + _size(code);}
+
+
 static void _exec_cb(char code, uint8_t *data) {
   switch (code) {
 #define CMD(CODE, NAME, SYNC, ...)                                      \
@@ -154,6 +168,9 @@ void command_flush_queue() {
   sync_q_init();
   cmd.count = 0;
   command_reset_position();
+  line_reset_stream();
+  line_reset_sync();
+  spindle_reset_queue();
 }
 
 
@@ -162,16 +179,36 @@ void command_push(char code, void *_data) {
   unsigned size = _size(code);
 
   if (!_is_synchronous(code)) estop_trigger(STAT_Q_INVALID_PUSH);
-  if (sync_q_space() <= size) estop_trigger(STAT_Q_OVERRUN);
+  if (sync_q_space() < _queued_size(code)) estop_trigger(STAT_Q_OVERRUN);
 
   sync_q_push(code);
+  sync_q_push(cmd.queue_id);
+  sync_q_push(cmd.queue_id >> 8);
   for (unsigned i = 0; i < size; i++) sync_q_push(*data++);
 
   ATOMIC_BLOCK(ATOMIC_RESTORESTATE) cmd.count++;
 }
 
 
-bool command_callback() {
+// The host may send up to the advertised byte count.  Credits are returned as
+// commands are consumed.  CTS is left as a safety net.
+static void _credit_update(bool force) {
+  if (!cmd.credit) return;
+
+  uint16_t count = usart_rx_count() - cmd.credit_start;
+  uint16_t consumed = count - cmd.credit_count;
+
+  if (force || SERIAL_CREDIT_BATCH <= consumed ||
+      (consumed && usart_rx_empty())) {
+    cmd.credit_count = count;
+    uint16_t limit = count + SERIAL_CREDIT_WINDOW;
+    printf_P(PSTR("{\"credit\":%u}\n"), limit);
+  }
+}
+
+
+// Returns true if a line was consumed
+static bool _process_line() {
   static char *block = 0;
 
   if (!block) block = usart_readline();
@@ -179,17 +216,28 @@ bool command_callback() {
 
   stat_t status = STAT_OK;
 
+  // Command ID prefix, a bare ID queues an ID only command
+  char *s = block;
+  uint16_t id = cmd.queue_id;
+  if (*s == COMMAND_id) {
+    char *end;
+    id = strtoul(s + 1, &end, 10);
+    if (end == s + 1) status = STAT_INVALID_ARGUMENTS;
+    else if (*end) s = end;
+  }
+
   // Special processing for synchronous commands
-  if (_is_synchronous(*block)) {
+  if (_is_synchronous(*s) && status == STAT_OK) {
     if (estop_triggered()) status = STAT_MACHINE_ALARMED;
     else if (state_is_flushing()) status = STAT_NOP; // Flush command
-    else if (state_is_resuming() || sync_q_space() <= _size(*block))
+    else if (state_is_resuming() || sync_q_space() < _queued_size(*s))
       return false; // Wait
   }
 
   // Dispatch non-empty commands
-  if (*block && status == STAT_OK) {
-    status = _dispatch(block);
+  if (*s && status == STAT_OK) {
+    cmd.queue_id = id;
+    status = _dispatch(s);
     if (status == STAT_OK) cmd.active = true; // Disables LCD booting message
   }
 
@@ -206,6 +254,27 @@ bool command_callback() {
 }
 
 
+// Process lines until input runs out, a command must wait or the time budget
+// is used up.  Draining bursts here keeps the main loop from being the
+// bottleneck for short moves.
+bool command_callback() {
+  uint32_t deadline = rtc_get_time() + COMMAND_INPUT_BUDGET;
+  uint16_t lines = 0;
+
+  while (_process_line()) {
+    lines++;
+    if (rtc_expired(deadline)) break;
+  }
+
+  if (!lines) return false;
+
+  if (cmd.lines_peak < lines) cmd.lines_peak = lines;
+  _credit_update(false);
+
+  return true;
+}
+
+
 void command_set_axis_position(int axis, const float p) {
   cmd.position[axis] = p;
 }
@@ -243,6 +312,9 @@ uint8_t *command_next() {
 
   if (!_is_synchronous((char)data[0])) estop_trigger(STAT_INVALID_QCMD);
 
+  cmd.next_id = sync_q_next();
+  cmd.next_id |= (uint16_t)sync_q_next() << 8;
+
   unsigned size = _size((char)data[0]);
   for (unsigned i = 0; i < size; i++)
     data[i + 1] = sync_q_next();
@@ -265,6 +337,7 @@ bool command_exec() {
       !rtc_expired(cmd.last_empty + EXEC_DELAY)) return false;
 
   uint8_t *data = command_next();
+  cmd.id = cmd.next_id; // Not set by lookahead dequeues
   state_running();
 
   _exec_cb((char)*data, data + 1);
@@ -273,6 +346,28 @@ bool command_exec() {
 }
 
 
+// Command callbacks
+stat_t command_id(char *block) {
+  command_push(COMMAND_id, 0);
+  return STAT_OK;
+}
+
+
+unsigned command_id_size() {return 0;}
+void command_id_exec(void *data) {} // ID is set when executed
+
+
+stat_t command_flow(char *block) {
+  cmd.credit = true;
+  cmd.credit_start = usart_rx_count();
+  cmd.credit_count = 0;
+  _credit_update(true);
+
+  return STAT_OK;
+}
+
+
 // Var callbacks
 uint16_t get_id() {return cmd.id;}
-void set_id(uint16_t id) {cmd.id = id;}
+uint16_t get_lines_peak() {return cmd.lines_peak;}
+void set_lines_peak(uint16_t x) {cmd.lines_peak = 0;}
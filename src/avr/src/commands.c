@@ -33,6 +33,7 @@
 #include "hardware.h"
 #include "report.h"
 #include "exec.h"
+#include "spindle.h"
 
 #include <stdio.h>
 
@@ -41,6 +42,7 @@ stat_t command_dwell(char *cmd) {
   float seconds;
   if (!b64_decode_float(cmd + 1, &seconds)) return STAT_BAD_FLOAT;
   command_push(*cmd, &seconds);
+  spindle_queue_move(seconds / 60, 0);
   return STAT_OK;
 }
 
@@ -55,6 +57,7 @@ unsigned command_dwell_size() {return sizeof(float);}
 
 
 void command_dwell_exec(void *seconds) {
+  spindle_advance(*(float *)seconds / 60);
   st_prep_dwell(*(float *)seconds);
   exec_set_cb(_dwell_exec); // Command must set an exec callback
 }
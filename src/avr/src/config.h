@@ -97,6 +97,7 @@ enum {
 #define OUTS                     6 // number of supported pin outputs
 #define ANALOG                   2 // number of supported analog inputs
 #define VFDREG                  32 // number of supported VFD modbus registers
+#define VFDTYPE                 16 // number of VFD register types
 
 // Switch settings.  See switch.c
 #define SWITCH_DEBOUNCE          5 // ms, default value
@@ -116,6 +117,7 @@ enum {
  *    HI    Serial RX                            usart.c
  *   MED    Serial TX                            usart.c (* see note)
  *   MED    Modbus serial interrupts             modbus.c
+ *   MED    Spindle index pin change             spindle_index.c
  *    LO    Segment execution SW interrupt       stepper.c
  *    LO    I2C Slave                            i2c.c
  *    LO    Real-time clock interrupt            rtc.c
@@ -128,7 +130,6 @@ enum {
  */
 
 // Timer assignments
-// NOTE, TCC1 is unused
 #define TIMER_STEP               TCC0 // Step timer (see stepper.h)
 #define TIMER_PWM                TCD1 // PWM timer  (see pwm.c)
 
@@ -162,19 +163,29 @@ enum {
 #define DRV8711_CTRL             (DRV8711_CTRL_ISGAIN_5 | \
                                   DRV8711_CTRL_DTIME_850)
 
+#define DRV8711_POLL_FAST        1  // ms, status poll period, active or faulted
+#define DRV8711_POLL_SLOW        16 // ms, status poll period otherwise
+
 
 // RS485 settings
 #define RS485_PORT               USARTD1
 #define RS485_DRE_vect           USARTD1_DRE_vect
 #define RS485_TXC_vect           USARTD1_TXC_vect
 #define RS485_RXC_vect           USARTD1_RXC_vect
+#define RS485_TIMER              TCC1 // Modbus frame timer (see modbus.c)
+#define RS485_TIMER_OVF_vect     TCC1_OVF_vect
+#define RS485_TIMER_CCA_vect     TCC1_CCA_vect
 
 
 // Modbus settings
 #define MODBUS_TIMEOUT           100 // ms. response timeout
 #define MODBUS_RETRIES           4   // Number of retries before failure
-#define MODBUS_BUF_SIZE          18  // Max bytes in rx/tx buffers
-#define VFD_QUERY_DELAY          100 // ms
+#define MODBUS_BUF_SIZE          32  // Max bytes in rx/tx buffers
+#define MODBUS_QUEUE_SIZE        8   // Max queued transactions
+#define MODBUS_MAX_READ          ((MODBUS_BUF_SIZE - 5) / 2) // Regs per read
+#define VFD_QUERY_DELAY          100 // ms between status polls
+#define VFD_LATENCY_BINS         6   // Round trip histogram bins
+#define VFD_LATENCY_MIN          4   // ms, first bin limit, doubles per bin
 
 
 // Serial settings
@@ -183,17 +194,48 @@ enum {
 #define SERIAL_DRE_vect          USARTC0_DRE_vect
 #define SERIAL_RXC_vect          USARTC0_RXC_vect
 #define SERIAL_CTS_THRESH        4
+#define SERIAL_BAUD_TIMEOUT      2000 // ms, revert unconfirmed baud change
+#define SERIAL_BAUD_MAX_ERRORS   4    // RX errors per second before revert
+#define SERIAL_CREDIT_WINDOW     960  // bytes host may have in flight
+#define SERIAL_CREDIT_BATCH      128  // bytes consumed between credit updates
 
 
 // PWM settings
 #define POWER_MAX_UPDATES        SEGMENT_MS
+#define POWER_LUT                8 // Power correction table points
+
+// Spindle settings
+#define SPINDLE_LEADS            8 // Speed changes tracked for lead time
+#define SPINDLE_INDEX_PIN        MAX_3_PIN // Shared with motor 3 max switch
+#define SPINDLE_INDEX_ISR_vect   PORTB_INT0_vect
+#define SPINDLE_INDEX_MIN        0.001 // sec, shorter periods are noise
+#define SPINDLE_INDEX_TIMEOUT    1     // sec, longer periods mean stopped
+#define SPINDLE_SYNC_MAX_SCALE   1.25  // Max speed up when catching spindle
+#define SPINDLE_SYNC_GAIN        0.25  // Fraction of sync lag corrected per seg
 
 // Input
 #define INPUT_BUFFER_LEN         128 // text buffer size (255 max)
+#define COMMAND_INPUT_BUDGET     2   // ms, max time spent parsing per pass
 
 
 // Report
 #define REPORT_RATE              250 // ms
+#define REPORT_RATE_FAST         20  // ms
+#define REPORT_RATE_SLOW         2000 // ms
+#define REPORT_FRAME_START       0x02
+#define REPORT_FRAME_SIZE        128 // max binary report payload
+
+
+// Config
+#define CONFIG_BLOB_VERSION      1
+#define CONFIG_BLOB_SIZE         512 // max bytes applied at once
+#define CONFIG_EEPROM_SIZE       1536 // EEPROM bytes for the config snapshot
+
+
+// Scope
+#define SCOPE_SAMPLES            24 // per segment samples in capture buffer
+#define SCOPE_PRETRIGGER         8  // samples kept from before the trigger
+#define SCOPE_AXES               2  // axis positions recorded per sample
 
 
 // I2C
@@ -206,6 +248,7 @@ enum {
 // Motor
 #define MOTOR_IDLE_TIMEOUT       0.25  // secs, motor off after this time
 #define MIN_STEP_CORRECTION      2
+#define MICROSTEP_HYSTERESIS     0.9   // Of coarse velocity, to switch back
 
 #define MIN_VELOCITY             10            // mm/min
 #define CURRENT_SENSE_RESISTOR   0.05          // ohms
@@ -32,8 +32,10 @@
 #include "estop.h"
 #include "exec.h"
 #include "motor.h"
+#include "rtc.h"
 
 #include <avr/interrupt.h>
+#include <util/atomic.h>
 #include <util/delay.h>
 #include <math.h>
 
@@ -56,6 +58,15 @@ typedef enum {
 } spi_state_t;
 
 
+// SPI work priorities, higher first
+typedef enum {
+  SPI_PRIO_NONE,
+  SPI_PRIO_POLL,   // Status polling and recovery
+  SPI_PRIO_CONFIG, // Configuration writes
+  SPI_PRIO_SYNC,   // Microstep changes between moves
+} spi_prio_t;
+
+
 bool motor_fault = false;
 
 
@@ -76,10 +87,14 @@ typedef struct {
   drv8711_state_t state;
   current_t drive;
   current_t idle;
+  current_t accel;    // Drive current at max acceleration, 0 if unused
+  float accel_phase;  // Fraction of max acceleration
   uint16_t last_torque_reg;
 
   uint8_t microstep;
   uint8_t last_microstep;
+  bool sync;          // Write microstep now, see drv8711_sync_microsteps()
+  bool configured;    // Registers written and read back
 
   struct {
     uint16_t reg;
@@ -93,6 +108,7 @@ typedef struct {
   } stall;
 
   spi_state_t spi_state;
+  uint32_t next_poll;
 } drv8711_driver_t;
 
 
@@ -105,6 +121,8 @@ static drv8711_driver_t drivers[DRIVERS] = {
 
 
 typedef struct {
+  volatile bool busy;
+  volatile bool sending;        // In the SPI interrupt
   bool advance;
   uint8_t disable_cs_pin;
 
@@ -154,13 +172,21 @@ static bool _driver_active(drv8711_driver_t *drv) {
 }
 
 
+// Scale between the drive and accel currents with acceleration
+static float _driver_scale(drv8711_driver_t *drv, float drive, float accel) {
+  if (!drv->accel.torque) return drive;
+  return drive + (accel - drive) * drv->accel_phase;
+}
+
+
 static float _driver_get_current(drv8711_driver_t *drv) {
   if (_driver_fault(drv)) return 0;
 
   switch (drv->state) {
   case DRV8711_IDLE: return drv->idle.current;
   case DRV8711_ACTIVE:
-    return drv->stall.detect ? drv->stall.current.current : drv->drive.current;
+    if (drv->stall.detect) return drv->stall.current.current;
+    return _driver_scale(drv, drv->drive.current, drv->accel.current);
   default: return 0; // Off
   }
 }
@@ -172,7 +198,8 @@ static uint8_t _driver_get_torque(drv8711_driver_t *drv) {
   switch (drv->state) {
   case DRV8711_IDLE:   return drv->idle.torque;
   case DRV8711_ACTIVE:
-    return drv->stall.detect ? drv->stall.current.torque : drv->drive.torque;
+    if (drv->stall.detect) return drv->stall.current.torque;
+    return round(_driver_scale(drv, drv->drive.torque, drv->accel.torque));
   default: return 0; // Off
   }
 }
@@ -217,6 +244,7 @@ static uint16_t _driver_spi_command(drv8711_driver_t *drv) {
     // idling with the driver enabled.
     bool enable = _driver_get_torque(drv);
     drv->last_microstep = drv->microstep;
+    drv->sync = false;
     return DRV8711_WRITE(DRV8711_CTRL_REG, DRV8711_CTRL | drv->microstep |
                          (enable ? DRV8711_CTRL_ENBL_bm : 0));
   }
@@ -234,14 +262,58 @@ static uint16_t _driver_spi_command(drv8711_driver_t *drv) {
 }
 
 
+static uint8_t _driver_poll_time(drv8711_driver_t *drv) {
+  if (motor_fault || drv->flags || _driver_active(drv))
+    return DRV8711_POLL_FAST;
+  return DRV8711_POLL_SLOW;
+}
+
+
+/// Returns the first register write needed to apply a configuration change
+/// or SS_READ_OFF if the driver is up to date.
+static spi_state_t _driver_config_write(drv8711_driver_t *drv) {
+  if (drv->stall.last_reg != drv->stall.reg) return SS_WRITE_STALL;
+  if (drv->last_torque_reg != _driver_get_torque_reg(drv))
+    return SS_WRITE_TORQUE;
+  if (drv->last_microstep != drv->microstep) return SS_WRITE_CTRL;
+  return SS_READ_OFF;
+}
+
+
+static spi_prio_t _driver_spi_prio(drv8711_driver_t *drv) {
+  if (drv->sync) return SPI_PRIO_SYNC;
+
+  switch (drv->spi_state) {
+  case SS_WRITE_OFF: // (Re)initialization waits for the poll timer
+    return rtc_expired(drv->next_poll) ? SPI_PRIO_POLL : SPI_PRIO_NONE;
+
+  case SS_READ_OFF:
+    if (_driver_config_write(drv) != SS_READ_OFF) return SPI_PRIO_CONFIG;
+    return rtc_expired(drv->next_poll) ? SPI_PRIO_POLL : SPI_PRIO_NONE;
+
+  case SS_READ_STATUS: case SS_CLEAR_STATUS: // Finish the poll
+    if (_driver_config_write(drv) != SS_READ_OFF) return SPI_PRIO_CONFIG;
+    return SPI_PRIO_POLL;
+
+  default: return SPI_PRIO_CONFIG; // Writing configuration
+  }
+}
+
+
 static spi_state_t _driver_spi_next(drv8711_driver_t *drv) {
   // Process response
   switch (drv->spi_state) {
   case SS_READ_OFF:
     // We read back the OFF register to test for communication failure.
-    if ((spi.response & 0x1ff) != DRV8711_OFF)
+    if ((spi.response & 0x1ff) != DRV8711_OFF) {
       drv->flags |= DRV8711_COMM_ERROR_bm;
-    else drv->flags &= ~DRV8711_COMM_ERROR_bm;
+      drv->configured = false;
+      drv->next_poll = rtc_get_time() + DRV8711_POLL_FAST;
+
+    } else {
+      drv->flags &= ~DRV8711_COMM_ERROR_bm;
+      drv->configured = true;
+    }
     break;
 
   case SS_READ_STATUS: {
@@ -258,6 +330,8 @@ static spi_state_t _driver_spi_next(drv8711_driver_t *drv) {
 
     // EStop on fatal driver faults
     if (_driver_fault(drv)) estop_trigger(STAT_MOTOR_FAULT);
+
+    drv->next_poll = rtc_get_time() + _driver_poll_time(drv);
     break;
   }
 
@@ -271,10 +345,6 @@ static spi_state_t _driver_spi_next(drv8711_driver_t *drv) {
 
   case SS_READ_STATUS:
     if (drv->reset_flags) return SS_CLEAR_STATUS;
-    if (drv->stall.last_reg != drv->stall.reg) return SS_WRITE_STALL;
-    if (drv->last_torque_reg != _driver_get_torque_reg(drv))
-      return SS_WRITE_TORQUE;
-    if (drv->last_microstep != drv->microstep) return SS_WRITE_CTRL;
     // Fall through
 
   case SS_CLEAR_STATUS: return SS_READ_OFF;
@@ -286,6 +356,33 @@ static spi_state_t _driver_spi_next(drv8711_driver_t *drv) {
 }
 
 
+/// Pick the driver with the most urgent SPI work, round-robin within a
+/// priority.  Returns -1 if there is nothing to do.
+static int8_t _spi_select() {
+  int8_t next = -1;
+  spi_prio_t prio = SPI_PRIO_NONE;
+
+  for (uint8_t i = 1; i <= DRIVERS; i++) {
+    uint8_t driver = (spi.driver + i) % DRIVERS;
+    spi_prio_t p = _driver_spi_prio(&drivers[driver]);
+
+    if (prio < p) {
+      next = driver;
+      prio = p;
+    }
+  }
+
+  // Microstep changes go straight to CTRL, other registers are rewritten later
+  if (prio == SPI_PRIO_SYNC) drivers[next].spi_state = SS_WRITE_CTRL;
+
+  // Configuration writes pre-empt status polls
+  else if (prio == SPI_PRIO_CONFIG && SS_READ_OFF <= drivers[next].spi_state)
+    drivers[next].spi_state = _driver_config_write(&drivers[next]);
+
+  return next;
+}
+
+
 static void _spi_send() {
   drv8711_driver_t *drv = &drivers[spi.driver];
 
@@ -296,16 +393,10 @@ static void _spi_send() {
   // Read byte
   *DRV8711_WORD_BYTE_PTR(spi.response, !spi.low_byte) = SPIC.DATA;
 
-  // Advance state and process response
+  // Handle response and set next state
   if (spi.advance) {
     spi.advance = false;
-
-    // Handle response and set next state
     drv->spi_state = _driver_spi_next(drv);
-
-    // Next driver
-    if (++spi.driver == DRIVERS) spi.driver = 0; // Wrap around
-    drv = &drivers[spi.driver];
   }
 
   // Disable CS
@@ -320,6 +411,16 @@ static void _spi_send() {
     spi.advance = true; // Word complete
 
   } else {
+    // Next word, stop when idle
+    int8_t next = _spi_select();
+    if (next == -1) {
+      spi.busy = false;
+      return;
+    }
+
+    spi.driver = next;
+    drv = &drivers[next];
+
     // Enable CS
     OUTSET_PIN(drv->cs_pin); // Set high (active)
     _delay_us(1);
@@ -336,7 +437,25 @@ static void _spi_send() {
 }
 
 
-ISR(SPIC_INT_vect) {_spi_send();}
+// NOTE, drv8711_sync_microsteps() also runs the transfers from the step timer
+// interrupt but leaves them alone while this one is sending.
+ISR(SPIC_INT_vect) {
+  spi.sending = true;
+  _spi_send();
+  spi.sending = false;
+}
+
+
+/// Start SPI transfers if idle.  A dummy byte, with no driver selected,
+/// raises the SPI interrupt.  Transfers stop when there is no work.
+static void _spi_kick() {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    if (!spi.busy) {
+      spi.busy = true;
+      SPIC.DATA = 0;
+    }
+  }
+}
 
 
 static void _motor_fault_switch_cb(switch_id_t sw, bool active) {
@@ -377,13 +496,22 @@ void drv8711_init() {
   PIN_PORT(SPI_CLK_PIN)->REMAP = PORT_SPI_bm; // Swap SCK and MOSI
   SPIC.INTCTRL = SPI_INTLVL_LO_gc; // interupt level
 
-  _spi_send(); // Kick it off
+  // Kick it off, the CS pins are all still high so no dummy byte
+  spi.busy = true;
+  _spi_send();
 }
 
 
+/// Called from the RTC interrupt to start due status polls
+void drv8711_rtc_callback() {_spi_kick();}
+
+
 void drv8711_set_state(int driver, drv8711_state_t state) {
-  if (driver < 0 || DRIVERS <= driver) return;
+  if (driver < 0 || DRIVERS <= driver || drivers[driver].state == state)
+    return;
+
   drivers[driver].state = state;
+  _spi_kick(); // Apply the new current before the move starts
 }
 
 
@@ -396,6 +524,51 @@ void drv8711_set_microsteps(int driver, uint16_t msteps) {
 }
 
 
+/// Change microstepping before the next step.  Called from the step timer
+/// interrupt, with the motor's clock stopped, so the SPI transfers are run
+/// here rather than waiting for the SPI interrupt.  Returns false if the
+/// driver is not responding or the SPI interrupt was interrupted, and so the
+/// mode could not be changed.
+bool drv8711_sync_microsteps(int driver, uint16_t msteps) {
+  if (driver < 0 || DRIVERS <= driver) return false;
+  drv8711_driver_t *drv = &drivers[driver];
+  uint8_t microstep = _microsteps(msteps);
+  if (microstep == 0xff || !drv->configured) return false;
+
+  // The SPI interrupt flag is cleared on entry, so a transfer without the flag
+  // set while a low level interrupt runs may be mid send.
+  if (spi.sending || (spi.busy && !(SPIC.STATUS & SPI_IF_bm) &&
+                      (PMIC.STATUS & PMIC_LOLVLEX_bm))) return false;
+
+  drv->microstep = microstep;
+  drv->sync = true;
+
+  if (!spi.busy) {
+    spi.busy = true;
+    _spi_send();
+  }
+
+  // Finish the current word then send CTRL and release CS
+  while (spi.busy && (drv->sync || (spi.driver == driver &&
+                                    drv->spi_state == SS_WRITE_CTRL))) {
+    while (!(SPIC.STATUS & SPI_IF_bm)) continue;
+    _spi_send();
+  }
+
+  return !drv->sync;
+}
+
+
+void drv8711_set_accel_phase(int driver, float phase) {
+  if (driver < 0 || DRIVERS <= driver) return;
+  drv8711_driver_t *drv = &drivers[driver];
+  if (drv->accel_phase == phase) return;
+
+  drv->accel_phase = phase;
+  if (drv->accel.torque && _driver_active(drv)) _spi_kick();
+}
+
+
 void drv8711_set_stalled(int driver, bool stalled) {
   if (driver < 0 || DRIVERS <= driver) return;
   drivers[driver].stalled = stalled;
@@ -460,6 +633,19 @@ void set_idle_current(int driver, float value) {
 }
 
 
+float get_accel_current(int driver) {
+  if (driver < 0 || DRIVERS <= driver) return 0;
+  return drivers[driver].accel.current;
+}
+
+
+void set_accel_current(int driver, float value) {
+  if (driver < 0 || DRIVERS <= driver || value < 0) return;
+  if (MAX_CURRENT < value) value = MAX_CURRENT;
+  _current_set(&drivers[driver].accel, value);
+}
+
+
 float get_active_current(int driver) {
   if (driver < 0 || DRIVERS <= driver) return 0;
   return _driver_get_current(&drivers[driver]);
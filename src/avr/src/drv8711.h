@@ -191,9 +191,12 @@ typedef void (*stall_callback_t)(int driver);
 
 
 void drv8711_init();
+void drv8711_rtc_callback();
 void drv8711_remap_switches();
 void drv8711_set_state(int driver, drv8711_state_t state);
 void drv8711_set_microsteps(int driver, uint16_t msteps);
+bool drv8711_sync_microsteps(int driver, uint16_t msteps);
+void drv8711_set_accel_phase(int driver, float phase);
 void drv8711_set_stalled(int driver, bool stalled);
 void drv8711_set_stall_detect(int driver, bool enable);
 bool drv8711_detect_stall(int driver);
@@ -36,6 +36,7 @@
 #include "outputs.h"
 #include "jog.h"
 #include "exec.h"
+#include "scope.h"
 
 
 static stat_t estop_reason = STAT_OK;
@@ -63,6 +64,9 @@ void estop_trigger(stat_t reason) {
   // Set fault signal
   outputs_set_active(FAULT_PIN, true);
 
+  // Freeze trace capture
+  scope_estop();
+
   // Shutdown peripherals
   st_shutdown();
   spindle_estop();
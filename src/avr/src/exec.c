@@ -39,6 +39,7 @@
 #include "spindle.h"
 #include "config.h"
 #include "SCurve.h"
+#include "scope.h"
 
 
 static struct {
@@ -99,6 +100,14 @@ float exec_get_acceleration() {return ex.accel;}
 void exec_set_jerk(float j) {ex.jerk = j;}
 
 
+/// Acceleration as a fraction of the segment's max, 0 when cruising
+float exec_get_accel_phase() {
+  if (!ex.seg.max_accel) return 0;
+  float phase = fabs(ex.accel) / ex.seg.max_accel;
+  return phase < 1 ? phase : 1;
+}
+
+
 void exec_set_cb(exec_cb_t cb) {ex.cb = cb;}
 
 
@@ -120,6 +129,9 @@ void exec_move_to_target(const float target[]) {
   // Update position
   copy_vector(ex.position, target);
 
+  // Record trace sample
+  scope_sample(ex.velocity, ex.accel, ex.jerk, target, ex.seg.power_updates);
+
   // Call the stepper prep function
   st_prep_line(target);
 }
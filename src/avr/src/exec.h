@@ -49,6 +49,7 @@ float exec_get_velocity();
 void exec_set_acceleration(float a);
 float exec_get_acceleration();
 void exec_set_jerk(float j);
+float exec_get_accel_phase();
 
 void exec_set_cb(exec_cb_t cb);
 
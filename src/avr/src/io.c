@@ -31,8 +31,10 @@
 #include "util.h"
 #include "command.h"
 #include "exec.h"
+#include "spindle.h"
 #include "rtc.h"
 #include "analog.h"
+#include "type.h"
 
 #include <ctype.h>
 #include <stdbool.h>
@@ -64,7 +66,9 @@ void io_callback() {
     if (active_cmd.digital) { // TODO
     } else result = analog_get(active_cmd.port);
 
-    printf_P(PSTR("{\"result\": %f}\n"), (double)result);
+    printf_P(PSTR("{\"result\":"));
+    type_print_f32(result);
+    printf_P(PSTR("}\n"));
     active_cmd.port = -1;
   }
 }
@@ -102,6 +106,7 @@ stat_t command_input(char *cmd) {
   if (!decode_float(&cmd, &input_cmd.timeout)) return STAT_BAD_FLOAT;
 
   command_push(COMMAND_input, &input_cmd);
+  spindle_queue_barrier();
 
   return STAT_OK;
 }
@@ -111,6 +116,7 @@ unsigned command_input_size() {return sizeof(input_cmd_t);}
 
 
 void command_input_exec(void *data) {
+  spindle_barrier_done();
   active_cmd = *(input_cmd_t *)data;
 
   timeout = rtc_get_time() + active_cmd.timeout * 1000;
@@ -25,16 +25,21 @@
 
 \******************************************************************************/
 
+#include "line.h"
 #include "config.h"
 #include "exec.h"
 #include "command.h"
 #include "spindle.h"
+#include "spindle_index.h"
+#include "state.h"
 #include "util.h"
 #include "SCurve.h"
+#include "base64.h"
 
 #include <math.h>
 #include <float.h>
 #include <string.h>
+#include <ctype.h>
 
 
 typedef struct {
@@ -55,6 +60,7 @@ static struct {
 
   uint8_t section;
   uint32_t seg;
+  float t; // Section time executed
 
   float iD; // Initial section distance
   float iV; // Initial section velocity
@@ -67,6 +73,25 @@ static struct {
 } l;
 
 
+// Sticky parameters of the compressed line stream, negative when unset
+static struct {
+  float target_vel;
+  float max_accel;
+  float max_jerk;
+  float quantum;
+} ls = {-1, -1, -1, -1};
+
+
+// Spindle synchronized motion.  Line time is advanced with spindle rotation
+// so position along the path follows the spindle angle, as for threading.
+static struct {
+  float rpm;      // Programmed spindle speed, zero when not synchronized
+  bool locked;    // Set once the start index pulse was seen
+  uint32_t index; // Index count before or at lock
+  float time;     // Line time executed since lock
+} sync;
+
+
 static void _segment_target(float target[AXES], float d) {
   for (int axis = 0; axis < AXES; axis++)
     target[axis] = l.line.start[axis] + l.line.unit[axis] * d;
@@ -121,27 +146,76 @@ static stat_t _exec_segment(float time, const float target[], float vel,
 }
 
 
+static bool _sync_lock() {
+  // Abandon the wait on stop
+  if (state_get() == STATE_STOPPING) {
+    exec_set_cb(0);
+    return false;
+  }
+
+  // Start on an index pulse so repeated passes align
+  if (spindle_index_count() == sync.index) return false;
+
+  sync.index = spindle_index_count();
+  sync.locked = true;
+  sync.time = 0;
+
+  return true;
+}
+
+
+static float _sync_step() {
+  // Line time lag behind the spindle when this segment starts
+  float revs = spindle_index_revs(sync.index, SEGMENT_TIME);
+  float lag = revs / sync.rpm - sync.time;
+
+  // Follow the spindle speed and correct the lag over several segments
+  float step = SEGMENT_TIME * spindle_index_rpm() / sync.rpm +
+    lag * SPINDLE_SYNC_GAIN;
+
+  // Limit the speed up when catching up
+  if (step < 0) return 0;
+  if (SEGMENT_TIME * SPINDLE_SYNC_MAX_SCALE < step)
+    return SEGMENT_TIME * SPINDLE_SYNC_MAX_SCALE;
+
+  return step;
+}
+
+
 static stat_t _line_exec() {
   // Compute times
   float section_time = l.line.times[l.section];
   float seg_time = SEGMENT_TIME;
-  float t = ++l.seg * SEGMENT_TIME;
+  float scale = 1; // Line time per real time
+  float t;
+
+  if (sync.rpm) {
+    if (!sync.locked && !_sync_lock()) return STAT_NOP; // Wait for index
+    scale = _sync_step() / SEGMENT_TIME;
+    t = l.t + SEGMENT_TIME * scale;
+
+  } else t = ++l.seg * SEGMENT_TIME;
 
   // Don't exceed section time
   if (section_time < t) {
-    seg_time = section_time - (l.seg - 1) * SEGMENT_TIME;
+    if (sync.rpm) seg_time = (section_time - l.t) / scale;
+    else seg_time = section_time - (l.seg - 1) * SEGMENT_TIME;
     t = section_time;
   }
 
-  // Compute distance and velocity
+  if (sync.rpm) sync.time += t - l.t;
+  l.t = t;
+
+  // Compute distance and velocity in line time
   float d = _segment_distance(t);
   float v = _segment_velocity(t);
-  float a = _segment_accel(t);
+  float a = _segment_accel(t) * scale * scale;
 
   // Don't allow overshoot
   if (l.line.length < d) d = l.line.length;
 
   // Handle synchronous speeds
+  spindle_advance(seg_time);
   spindle_load_power_updates(l.power_updates, l.lD, d);
   l.lD = d;
 
@@ -150,6 +224,7 @@ static stat_t _line_exec() {
     if (_section_next()) {
       // Setup next section
       l.seg = 0;
+      l.t = 0;
       l.iD = d;
       l.iV = v;
 
@@ -158,7 +233,8 @@ static stat_t _line_exec() {
 
       // Last segment of last section
       // Use exact target values to correct for floating-point errors
-      return _exec_segment(seg_time, l.line.target, l.line.target_vel, a);
+      return _exec_segment(seg_time, l.line.target, l.line.target_vel * scale,
+                           a);
     }
   }
 
@@ -166,11 +242,70 @@ static stat_t _line_exec() {
   float target[AXES];
   _segment_target(target, d);
 
-  // Segment move
-  return _exec_segment(seg_time, target, v, a);
+  // Segment move, velocity in real time
+  return _exec_segment(seg_time, target, v * scale, a);
+}
+
+
+static stat_t _decode_times(char **cmd, line_t *line) {
+  bool has_time = false;
+
+  while (**cmd) {
+    if (**cmd < '0' || '6' < **cmd) break;
+    int section = *(*cmd)++ - '0';
+
+    float time;
+    if (!decode_float(cmd, &time)) return STAT_BAD_FLOAT;
+
+    if (time < 0) return STAT_NEGATIVE_SCURVE_TIME;
+    line->times[section] = time;
+    if (time) has_time = true;
+  }
+
+  if (!has_time) return STAT_ALL_ZERO_SCURVE_TIMES;
+
+  // Check for end of command
+  return **cmd ? STAT_INVALID_ARGUMENTS : STAT_OK;
 }
 
 
+static void _push(line_t *line) {
+  // Set next start position
+  command_set_position(line->target);
+
+  // Compute direction vector
+  for (int axis = 0; axis < AXES; axis++) {
+    line->unit[axis] = line->target[axis] - line->start[axis];
+    line->length += line->unit[axis] * line->unit[axis];
+  }
+
+  line->length = sqrt(line->length);
+  for (int axis = 0; axis < AXES; axis++)
+    if (line->unit[axis]) line->unit[axis] /= line->length;
+
+  // Queue
+  command_push(COMMAND_line, line);
+
+  float time = 0;
+  for (int i = 0; i < 7; i++) time += line->times[i];
+  spindle_queue_move(time, line->length);
+}
+
+
+static stat_t _decode_param(char **cmd, float *value) {
+  if (!decode_float(cmd, value)) return STAT_BAD_FLOAT;
+  return *value < 0 ? STAT_INVALID_ARGUMENTS : STAT_OK;
+}
+
+
+void line_reset_stream() {
+  ls.target_vel = ls.max_accel = ls.max_jerk = ls.quantum = -1;
+}
+
+
+void line_reset_sync() {sync.rpm = 0;}
+
+
 stat_t command_line(char *cmd) {
   line_t line = {};
 
@@ -197,40 +332,10 @@ stat_t command_line(char *cmd) {
   if (status) return status;
 
   // Get times
-  bool has_time = false;
-  while (*cmd) {
-    if (*cmd < '0' || '6' < *cmd) break;
-    int section = *cmd - '0';
-    cmd++;
-
-    float time;
-    if (!decode_float(&cmd, &time)) return STAT_BAD_FLOAT;
-
-    if (time < 0) return STAT_NEGATIVE_SCURVE_TIME;
-    line.times[section] = time;
-    if (time) has_time = true;
-   }
-
-  if (!has_time) return STAT_ALL_ZERO_SCURVE_TIMES;
-
-  // Check for end of command
-  if (*cmd) return STAT_INVALID_ARGUMENTS;
-
-  // Set next start position
-  command_set_position(line.target);
-
-  // Compute direction vector
-  for (int axis = 0; axis < AXES; axis++) {
-    line.unit[axis] = line.target[axis] - line.start[axis];
-    line.length += line.unit[axis] * line.unit[axis];
-  }
+  status = _decode_times(&cmd, &line);
+  if (status) return status;
 
-  line.length = sqrt(line.length);
-  for (int axis = 0; axis < AXES; axis++)
-    if (line.unit[axis]) line.unit[axis] /= line.length;
-
-  // Queue
-  command_push(COMMAND_line, &line);
+  _push(&line);
 
   return STAT_OK;
 }
@@ -244,6 +349,7 @@ void command_line_exec(void *data) {
 
   // Setup first section
   l.seg = 0;
+  l.t = 0;
   l.iD = 0;
   l.lD = 0;
   // If current velocity is non-zero use last target velocity
@@ -272,3 +378,100 @@ void command_line_exec(void *data) {
   // Set callback
   exec_set_cb(_line_exec);
 }
+
+
+// Compressed line.  Parameters are sticky and only sent when they change.
+// Lower case axes are deltas from the current position in multiples of the
+// quantum, upper case axes are absolute.
+stat_t command_line_delta(char *cmd) {
+  line_t line = {};
+  stat_t status;
+
+  cmd++; // Skip command code
+
+  // Sticky parameters
+  while (*cmd) {
+    float *param;
+
+    switch (*cmd) {
+    case 'V': param = &ls.target_vel; break;
+    case 'M': param = &ls.max_accel; break;
+    case 'J': param = &ls.max_jerk; break;
+    case 'Q': param = &ls.quantum; break;
+    default: param = 0; break;
+    }
+
+    if (!param) break;
+    cmd++;
+
+    float value;
+    if ((status = _decode_param(&cmd, &value))) return status;
+    *param = value;
+  }
+
+  if (ls.target_vel < 0 || ls.max_accel < 0 || ls.max_jerk < 0)
+    return STAT_INVALID_ARGUMENTS;
+
+  line.target_vel = ls.target_vel;
+  line.max_accel = ls.max_accel;
+  line.max_jerk = ls.max_jerk;
+
+  // Get start position
+  command_get_position(line.start);
+  copy_vector(line.target, line.start);
+
+  // Get target position
+  while (*cmd) {
+    const char *names = "xyzabc";
+    const char *match = strchr(names, tolower(*cmd));
+    if (!match) break;
+    int axis = match - names;
+
+    if (islower(*cmd++)) {
+      int32_t delta;
+      if (ls.quantum <= 0 || !b64_decode_int(cmd, 3, &delta))
+        return STAT_INVALID_ARGUMENTS;
+      cmd += 3;
+
+      line.target[axis] += delta * ls.quantum;
+
+    } else if (!decode_float(&cmd, &line.target[axis])) return STAT_BAD_FLOAT;
+  }
+
+  // Get times
+  if ((status = _decode_times(&cmd, &line))) return status;
+
+  _push(&line);
+
+  return STAT_OK;
+}
+
+
+unsigned command_line_delta_size() {return sizeof(line_t);}
+void command_line_delta_exec(void *data) {command_line_exec(data);}
+
+
+// Spindle synchronization
+stat_t command_spindle_sync(char *cmd) {
+  float rpm;
+
+  cmd++; // Skip command code
+
+  if (!decode_float(&cmd, &rpm) || rpm < 0) return STAT_BAD_FLOAT;
+  if (*cmd) return STAT_INVALID_ARGUMENTS;
+  if (rpm && !spindle_index_enabled()) return STAT_SPINDLE_NO_INDEX;
+
+  command_push(COMMAND_spindle_sync, &rpm);
+
+  return STAT_OK;
+}
+
+
+unsigned command_spindle_sync_size() {return sizeof(float);}
+
+
+void command_spindle_sync_exec(void *data) {
+  sync.rpm = *(float *)data;
+  sync.locked = false;
+  sync.index = spindle_index_count();
+}
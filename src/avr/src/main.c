@@ -41,6 +41,8 @@
 #include "outputs.h"
 #include "analog.h"
 #include "modbus.h"
+#include "vfd_spindle.h"
+#include "scope.h"
 #include "io.h"
 #include "exec.h"
 #include "state.h"
@@ -93,10 +95,14 @@ int main(int argc, char *argv[]) {
     emu_callback();               // Emulator callback
     hw_reset_handler();           // handle hard reset requests
     state_callback();             // manage state
+    usart_callback();             // serial baud rate changes
     command_callback();           // process next command
     modbus_callback();            // handle modbus events
+    vfd_spindle_callback();       // VFD spindle control
     io_callback();                // handle io input
     report_callback();            // report changes
+    vars_callback();              // save config snapshot
+    scope_callback();             // stream trace capture
   }
 
   return 0;
@@ -47,6 +47,7 @@ typedef enum {
   MODBUS_CRC,
   MODBUS_INVALID,
   MODBUS_TIMEDOUT,
+  MODBUS_EXCEPTION,
 } modbus_status_t;
 
 
@@ -64,23 +65,49 @@ static struct {
   uint8_t command_length;
   uint8_t response[MODBUS_BUF_SIZE];
   uint8_t response_length;
+  uint8_t expected; // Length of a normal response
 
-  uint16_t addr;
-  modbus_rw_cb_t rw_cb;
   modbus_cb_t receive_cb;
 
   uint32_t last_write;
-  uint32_t last_read;
+  uint32_t first_write; // RTC counts
+  uint32_t frame_end;   // RTC counts
+  modbus_transfer_t transfer;
   uint8_t retry;
   uint8_t status;
+  uint8_t exception;
   uint16_t crc_errs;
   bool write_ready;
   bool response_ready;
   bool transmit_complete;
+  bool char_gap;
+  bool frame_error;
   bool busy;
 } state = {0};
 
 
+// Huanyang functions are queued with the exception bit set to tell them apart
+#define MODBUS_HUANYANG 0x80
+
+
+typedef struct {
+  uint8_t func;
+  uint8_t prio;
+  bool batch;     // Read may be coalesced with others
+  uint16_t addr;
+  uint16_t value; // Value to write or number of registers to read
+  modbus_rw_cb_t cb;
+} modbus_txn_t;
+
+
+static struct {
+  modbus_txn_t txns[MODBUS_QUEUE_SIZE];
+  uint8_t length;
+  uint8_t sent; // Transactions at the front of the queue being sent
+  uint16_t addr; // First register of the request being sent
+} queue;
+
+
 static uint16_t _crc16(const uint8_t *buffer, unsigned length) {
   uint16_t crc = 0xffff;
 
@@ -134,15 +161,31 @@ static void _debug_transfer() {
   if (!cfg.debug) return;
 
   char out[state.command_length * 2 + 1];
-  char in[state.response_length * 2 + 1];
+  uint8_t length = state.response_length;
+  if (MODBUS_BUF_SIZE < length) length = MODBUS_BUF_SIZE;
+
+  char in[length * 2 + 1];
   format_hex_buf(out, state.command, state.command_length);
-  format_hex_buf(in, state.response, state.response_length);
+  format_hex_buf(in, state.response, length);
 
   STATUS_DEBUG("modbus: out=0x%s in=0x%s", out, in);
 }
 
 
 static bool _check_response() {
+  uint8_t length = state.response_length;
+
+  // Check framing
+  if (length < 4 || MODBUS_BUF_SIZE < length || state.frame_error) {
+    if (cfg.debug) {
+      STATUS_WARNING(STAT_OK, "modbus: broken frame, length=%u", length);
+      _debug_transfer();
+    }
+
+    state.status = MODBUS_INVALID;
+    return false;
+  }
+
   // Check CRC
   uint16_t computed = _crc16(state.response, state.response_length - 2);
   uint16_t expected =
@@ -156,6 +199,7 @@ static bool _check_response() {
     }
 
     state.crc_errs++;
+    state.transfer.crc_errs++;
     state.status = MODBUS_CRC;
     return false;
   }
@@ -169,6 +213,17 @@ static bool _check_response() {
     return false;
   }
 
+  // Check for an exception response
+  if (state.response[1] == (state.command[1] | 0x80) && length == 5) {
+    if (cfg.debug || state.exception != state.response[2])
+      STATUS_WARNING(STAT_OK, "modbus: exception %u to function %u",
+                     state.response[2], state.command[1]);
+
+    state.exception = state.response[2];
+    state.status = MODBUS_EXCEPTION;
+    return false;
+  }
+
   // Check that function code matches
   if (state.command[1] != state.response[1]) {
     STATUS_WARNING(STAT_OK, "modbus: invalid function code, expected=%u got=%u",
@@ -178,6 +233,15 @@ static bool _check_response() {
     return false;
   }
 
+  // Check length
+  if (length != state.expected) {
+    STATUS_WARNING(STAT_OK, "modbus: invalid length, expected=%u got=%u",
+                   state.expected, length);
+    _debug_transfer();
+    state.status = MODBUS_INVALID;
+    return false;
+  }
+
   return true;
 }
 
@@ -192,22 +256,6 @@ static void _notify(uint8_t func, uint8_t bytes, const uint8_t *data) {
 }
 
 
-static void _handle_response() {
-  if (!state.response_ready) return;
-  state.response_ready = false;
-
-  if (!_check_response()) return;
-
-  state.last_write = 0;             // Clear timeout timer
-  state.last_read = rtc_get_time(); // Set delay timer
-  state.retry = 0;                  // Reset retry counter
-  state.status = MODBUS_OK;
-  state.busy = false;
-
-  _notify(state.response[1], state.response_length - 4, state.response + 2);
-}
-
-
 /// Data register empty interrupt
 ISR(RS485_DRE_vect) {
   RS485_PORT.DATA = state.command[state.bytes++];
@@ -225,35 +273,102 @@ ISR(RS485_TXC_vect) {
   _set_txc_interrupt(false);
   _set_rxc_interrupt(true);
   _set_write(false); // Switch to read mode
+  state.char_gap = state.frame_error = false;
   state.transmit_complete = true;
 }
 
 
+static void _frame_timer_stop() {RS485_TIMER.CTRLA = TC_CLKSEL_OFF_gc;}
+
+
 /// Data received interrupt
 ISR(RS485_RXC_vect) {
-  state.response[state.bytes] = RS485_PORT.DATA;
+  uint8_t data = RS485_PORT.DATA;
 
   // Ignore leading zeros
-  if (state.bytes || state.response[0]) state.bytes++;
+  if (!state.bytes && !data) return;
 
-  if (state.bytes == state.response_length) {
-    _set_rxc_interrupt(false);
-    _set_write(true); // Back to write mode
-    state.bytes = 0;
-    state.response_ready = true;
+  // Count one byte past the buffer to detect overflow
+  if (state.bytes < MODBUS_BUF_SIZE) state.response[state.bytes] = data;
+  if (state.bytes <= MODBUS_BUF_SIZE) state.bytes++;
+
+  // A gap of more than 1.5 characters within a frame is an error
+  if (state.char_gap) state.frame_error = true;
+  state.char_gap = false;
+
+  // Restart the frame timer
+  _frame_timer_stop();
+  RS485_TIMER.CNT = 0;
+  RS485_TIMER.CTRLA = TC_CLKSEL_DIV64_gc;
+}
+
+
+/// 1.5 characters since the last byte
+ISR(RS485_TIMER_CCA_vect) {state.char_gap = true;}
+
+
+/// 3.5 characters since the last byte, end of frame
+ISR(RS485_TIMER_OVF_vect) {
+  _frame_timer_stop();
+  _set_rxc_interrupt(false);
+  _set_write(true); // Back to write mode
+  state.frame_end = rtc_get_counts();
+  state.response_length = state.bytes;
+  state.bytes = 0;
+  state.response_ready = true;
+}
+
+
+// Move a transaction to the end of those being sent
+static void _queue_take(uint8_t i) {
+  modbus_txn_t txn = queue.txns[i];
+  memmove(queue.txns + queue.sent + 1, queue.txns + queue.sent,
+          (i - queue.sent) * sizeof(modbus_txn_t));
+  queue.txns[queue.sent++] = txn;
+}
+
+
+/// Remove the sent transactions then pass their results to the callbacks.
+/// @param regs is the register data of a read response or the value returned
+/// by a Huanyang function.
+static void _queue_done(bool ok, const uint8_t *regs) {
+  uint8_t count = queue.sent;
+  uint16_t addr = queue.addr;
+  modbus_txn_t done[count];
+
+  memcpy(done, queue.txns, count * sizeof(modbus_txn_t));
+  queue.length -= count;
+  memmove(queue.txns, queue.txns + count,
+          queue.length * sizeof(modbus_txn_t));
+  queue.sent = 0;
+
+  // Callbacks may queue more transactions
+  for (uint8_t i = 0; i < count; i++) {
+    const modbus_txn_t &txn = done[i];
+    if (!txn.cb) continue;
+
+    if (!ok) txn.cb(false, txn.addr, 0);
+    else if (txn.func == MODBUS_READ_OUTPUT_REG)
+      for (uint16_t j = 0; j < txn.value; j++) {
+        const uint8_t *reg = regs + (txn.addr + j - addr) * 2;
+        txn.cb(true, txn.addr + j, _read_word(reg, false));
+      }
+    else if (regs) txn.cb(true, txn.addr, _read_word(regs, false));
+    else txn.cb(true, txn.addr, txn.value);
   }
 }
 
 
 static void _read_cb(uint8_t func, uint8_t bytes, const uint8_t *data) {
-  if (func == MODBUS_READ_OUTPUT_REG && data[0] == bytes - 1) {
-    if (state.rw_cb)
-      for (uint8_t i = 0; i < bytes >> 1; i++)
-        state.rw_cb(true, state.addr + i, _read_word(data + i * 2 + 1, false));
+  if (func == MODBUS_READ_OUTPUT_REG && data &&
+      data[0] == bytes - 1) {
+    _queue_done(true, data + 1);
     return;
   }
 
-  if (state.rw_cb) state.rw_cb(false, state.addr, 0);
+  _queue_done(false, 0);
+  if (!data) return; // Timeouts and exceptions are already reported
+
   STATUS_WARNING(STAT_OK, "modbus: unexpected response to read");
   _debug_transfer();
 }
@@ -262,22 +377,43 @@ static void _read_cb(uint8_t func, uint8_t bytes, const uint8_t *data) {
 static void _write_cb(uint8_t func, uint8_t bytes, const uint8_t *data) {
   if ((func == MODBUS_WRITE_OUTPUT_REG ||
        func == MODBUS_WRITE_OUTPUT_REGS) && bytes == 4 &&
-      _read_word(data, false) == state.addr) {
-    if (state.rw_cb)
-      state.rw_cb(true, state.addr, _read_word(state.command + 4, false));
+      _read_word(data, false) == queue.addr) {
+    _queue_done(true, 0);
     return;
   }
 
-  if (state.rw_cb) state.rw_cb(false, state.addr, 0);
+  _queue_done(false, 0);
+  if (!data) return; // Timeouts and exceptions are already reported
+
   STATUS_WARNING(STAT_OK, "modbus: unexpected response to write");
   _debug_transfer();
 }
 
 
+static void _huanyang_cb(uint8_t func, uint8_t bytes, const uint8_t *data) {
+  const modbus_txn_t &txn = queue.txns[0];
+
+  if (data && func == (txn.func & ~MODBUS_HUANYANG) && 1 < bytes &&
+      data[0] == bytes - 1) {
+    // The value is in the last two bytes, control writes return one byte
+    uint8_t value[2] = {0, data[1]};
+    _queue_done(true, bytes == 2 ? value : data + bytes - 2);
+    return;
+  }
+
+  _queue_done(false, 0);
+  if (!data) return; // Timeouts are already reported
+
+  STATUS_WARNING(STAT_OK, "modbus: unexpected Huanyang response");
+  _debug_transfer();
+}
+
+
 static void _reset() {
   _set_dre_interrupt(false);
   _set_txc_interrupt(false);
   _set_rxc_interrupt(false);
+  _frame_timer_stop();
   _set_write(true); // RS485 write mode
 
   // Flush USART
@@ -295,11 +431,13 @@ static void _retry() {
   state.last_write = 0;
   state.bytes = 0;
   state.retry++;
+  state.transfer.retries = state.retry;
 
   _set_write(true); // RS485 write mode
 
   _set_txc_interrupt(false);
   _set_rxc_interrupt(false);
+  _frame_timer_stop();
   _set_dre_interrupt(true);
 
   // Try changing pin polarity
@@ -317,20 +455,75 @@ static void _timeout() {
 
   if (state.status == MODBUS_OK || state.status == MODBUS_DISCONNECTED)
     state.status = MODBUS_TIMEDOUT;
+  state.transfer.timedout = true;
 
   _reset();
   _notify(state.command[1], 0, 0);
 }
 
 
+static void _retry_or_timeout() {
+  if (state.retry < 2 * MODBUS_RETRIES) _retry();
+  else _timeout();
+}
+
+
+static void _handle_response() {
+  if (!state.response_ready) return;
+  state.response_ready = false;
+  state.last_write = 0; // Clear timeout timer
+
+  if (!_check_response()) {
+    // Retry right away, the frame timer ensures the line is idle
+    if (state.status != MODBUS_EXCEPTION) _retry_or_timeout();
+    else {
+      // The slave rejected the request, retrying will not help
+      _reset();
+      _notify(state.command[1], 0, 0);
+    }
+
+    return;
+  }
+
+  state.retry = 0; // Reset retry counter
+  state.status = MODBUS_OK;
+  state.transfer.latency = state.frame_end - state.first_write;
+  state.busy = false;
+
+  _notify(state.response[1], state.response_length - 4, state.response + 2);
+}
+
+
 static stop_t _get_stop() {
   // RTU mode characters must always be 11-bits long
   return cfg.parity == USART_NONE ? USART_2STOP : USART_1STOP;
 }
 
 
+static uint16_t _frame_timer_ticks(uint16_t us) {
+  return (uint32_t)us * (F_CPU / 64000) / 1000 + 1;
+}
+
+
+static void _set_frame_timing() {
+  // Frames end after 3.5 characters of silence and a gap of more than 1.5
+  // characters within a frame is an error.  There are 11-bits per character
+  // in RTU mode.  Character time is calculated as follows:
+  //
+  //     char time = 11-bits / baud
+  //
+  // Above 19200 baud the spec fixes the times at 750us and 1.75ms.  The
+  // minimum delay between frames is also 3.5 characters.  Because a response
+  // is only handled after this time the next request can be sent right away.
+  uint32_t bps = usart_get_bps(cfg.baud);
+  RS485_TIMER.CCA = _frame_timer_ticks(bps <= 19200 ? 16500000 / bps : 750);
+  RS485_TIMER.PER = _frame_timer_ticks(bps <= 19200 ? 38500000 / bps : 1750);
+}
+
+
 void modbus_init() {
   PR.PRPD &= ~PR_USART1_bm; // Disable power reduction
+  PR.PRPC &= ~PR_TC1_bm;    // Disable power reduction
 
   DIRCLR_PIN(RS485_RO_PIN); // Input
   OUTSET_PIN(RS485_DI_PIN); // High
@@ -340,15 +533,23 @@ void modbus_init() {
 
   _reset();
   memset(&state, 0, sizeof(state));
+  memset(&queue, 0, sizeof(queue));
   state.status = MODBUS_DISCONNECTED;
 
   usart_init_port(&RS485_PORT, cfg.baud, cfg.parity, USART_8BITS, _get_stop());
+
+  // Frame timer
+  RS485_TIMER.CTRLB = TC_WGMODE_NORMAL_gc;
+  RS485_TIMER.INTCTRLA = TC_OVFINTLVL_MED_gc;
+  RS485_TIMER.INTCTRLB = TC_CCAINTLVL_MED_gc;
+  _set_frame_timing();
 }
 
 
 void modbus_deinit() {
   _reset();
   memset(&state, 0, sizeof(state));
+  memset(&queue, 0, sizeof(queue));
   state.status = MODBUS_DISCONNECTED;
 
   // Disable USART
@@ -365,21 +566,6 @@ bool modbus_busy() {return state.busy;}
 
 static void _start_write() {
   if (!state.write_ready) return;
-
-  // The minimum delay between modbus messages is 3.5 characters.  There are
-  // 11-bits per character in RTU mode.  Character time is calculated as
-  // follows:
-  //
-  //     char time = 11-bits / baud * 3.5
-  //
-  // At 9600 baud the minimum delay is 4.01ms.  At 19200 it's 2.005ms.  All
-  // supported higher baud rates require the 1.75ms minimum delay.  We round up
-  // and add 1ms to ensure the delay is never less than the required minimum.
-  if (state.last_read &&
-      !rtc_expired(state.last_read + (cfg.baud == USART_BAUD_9600 ? 5 : 3)))
-    return;
-  state.last_read = 0;
-
   state.write_ready = false;
   _set_dre_interrupt(true);
 }
@@ -389,14 +575,14 @@ void modbus_func(uint8_t func, uint8_t send, const uint8_t *data,
                  uint8_t receive, modbus_cb_t receive_cb) {
   state.bytes = 0;
   state.command_length = send + 4;
-  state.response_length = receive + 4;
+  state.expected = receive + 4;
   state.receive_cb = receive_cb;
   state.last_write = 0;
   state.retry = 0;
+  memset(&state.transfer, 0, sizeof(state.transfer));
 
   ESTOP_ASSERT(state.command_length <= MODBUS_BUF_SIZE, STAT_MODBUS_BUF_LENGTH);
-  ESTOP_ASSERT(state.response_length <= MODBUS_BUF_SIZE,
-               STAT_MODBUS_BUF_LENGTH);
+  ESTOP_ASSERT(state.expected <= MODBUS_BUF_SIZE, STAT_MODBUS_BUF_LENGTH);
 
   state.command[0] = cfg.id;
   state.command[1] = func;
@@ -405,42 +591,154 @@ void modbus_func(uint8_t func, uint8_t send, const uint8_t *data,
 
   state.busy = true;
   state.write_ready = true;
+  state.first_write = rtc_get_counts();
   _start_write();
 }
 
 
-void modbus_read(uint16_t addr, uint16_t count, modbus_rw_cb_t cb) {
-  state.rw_cb = cb;
-  state.addr = addr;
+static void _send_huanyang(const modbus_txn_t &txn) {
+  uint8_t func = txn.func & ~MODBUS_HUANYANG;
   uint8_t cmd[4];
-  _write_word(cmd, addr, false);
-  _write_word(cmd + 2, count, false);
-  modbus_func(MODBUS_READ_OUTPUT_REG, 4, cmd, 2 * count + 1, _read_cb);
+  uint8_t length = 0;
+
+  // [length][data], parameter and control reads and writes are addressed
+  if (func != HUANYANG_CTRL_WRITE && func != HUANYANG_FREQ_WRITE)
+    cmd[++length] = txn.addr;
+
+  if (func == HUANYANG_CTRL_WRITE) cmd[++length] = txn.value;
+  else if (func == HUANYANG_FUNC_WRITE || func == HUANYANG_FREQ_WRITE) {
+    _write_word(cmd + length + 1, txn.value, false);
+    length += 2;
+  }
+
+  cmd[0] = length;
+
+  // Responses are the same length except reads which also return a value
+  uint8_t receive = length + 1;
+  if (func == HUANYANG_FUNC_READ || func == HUANYANG_CTRL_READ) receive += 2;
+
+  modbus_func(func, length + 1, cmd, receive, _huanyang_cb);
 }
 
 
-void modbus_write(uint16_t addr, uint16_t value, modbus_rw_cb_t cb) {
-  state.rw_cb = cb;
-  state.addr = addr;
-  uint8_t cmd[4];
-  _write_word(cmd, addr, false);
-  _write_word(cmd + 2, value, false);
-  modbus_func(MODBUS_WRITE_OUTPUT_REG, 4, cmd, 4, _write_cb);
+static uint16_t _txn_end(const modbus_txn_t &txn) {
+  return txn.addr + txn.value;
 }
 
 
-void modbus_multi_write(uint16_t addr, uint16_t value, modbus_rw_cb_t cb) {
-  state.rw_cb = cb;
-  state.addr = addr;
-  uint8_t cmd[7];
-  _write_word(cmd, addr, false);      // Start address
-  _write_word(cmd + 2, 1, false);     // Number of regs
-  cmd[4] = 2;                         // Number of bytes
-  _write_word(cmd + 5, value, false); // Value
-  modbus_func(MODBUS_WRITE_OUTPUT_REGS, 7, cmd, 4, _write_cb);
+static void _queue_send() {
+  if (state.busy || queue.sent || !queue.length) return;
+
+  // Highest priority first, oldest first within a priority
+  uint8_t next = 0;
+  for (uint8_t i = 1; i < queue.length; i++)
+    if (queue.txns[next].prio < queue.txns[i].prio) next = i;
+  _queue_take(next);
+
+  modbus_txn_t &txn = queue.txns[0];
+  queue.addr = txn.addr;
+
+  switch (txn.func) {
+  case MODBUS_READ_OUTPUT_REG: {
+    // Coalesce queued reads which overlap or adjoin the register range
+    uint16_t end = _txn_end(txn);
+
+    for (uint8_t i = queue.sent; txn.batch && i < queue.length; i++) {
+      const modbus_txn_t &read = queue.txns[i];
+      if (read.func != MODBUS_READ_OUTPUT_REG || !read.batch) continue;
+      if (_txn_end(read) < queue.addr || end < read.addr) continue;
+
+      uint16_t lo = read.addr < queue.addr ? read.addr : queue.addr;
+      uint16_t hi = end < _txn_end(read) ? _txn_end(read) : end;
+      if (MODBUS_MAX_READ < hi - lo) continue;
+
+      queue.addr = lo;
+      end = hi;
+      _queue_take(i);
+      i = queue.sent - 1; // Rescan, the range has grown
+    }
+
+    uint8_t cmd[4];
+    uint8_t count = end - queue.addr;
+    _write_word(cmd, queue.addr, false);
+    _write_word(cmd + 2, count, false);
+    modbus_func(MODBUS_READ_OUTPUT_REG, 4, cmd, 2 * count + 1, _read_cb);
+    break;
+  }
+
+  case MODBUS_WRITE_OUTPUT_REG: {
+    uint8_t cmd[4];
+    _write_word(cmd, txn.addr, false);
+    _write_word(cmd + 2, txn.value, false);
+    modbus_func(MODBUS_WRITE_OUTPUT_REG, 4, cmd, 4, _write_cb);
+    break;
+  }
+
+  case MODBUS_WRITE_OUTPUT_REGS: {
+    uint8_t cmd[7];
+    _write_word(cmd, txn.addr, false);      // Start address
+    _write_word(cmd + 2, 1, false);         // Number of regs
+    cmd[4] = 2;                             // Number of bytes
+    _write_word(cmd + 5, txn.value, false); // Value
+    modbus_func(MODBUS_WRITE_OUTPUT_REGS, 7, cmd, 4, _write_cb);
+    break;
+  }
+
+  default: _send_huanyang(txn); break;
+  }
 }
 
 
+static bool _queue_push(uint8_t func, uint16_t addr, uint16_t value,
+                        bool batch, modbus_prio_t prio, modbus_rw_cb_t cb) {
+  if (queue.length == MODBUS_QUEUE_SIZE) return false;
+
+  modbus_txn_t &txn = queue.txns[queue.length++];
+  txn.func = func;
+  txn.prio = prio;
+  txn.batch = batch;
+  txn.addr = addr;
+  txn.value = value;
+  txn.cb = cb;
+
+  return true;
+}
+
+
+bool modbus_read(uint16_t addr, uint8_t count, bool batch, modbus_prio_t prio,
+                 modbus_rw_cb_t cb) {
+  if (!count || MODBUS_MAX_READ < count) return false;
+  return _queue_push(MODBUS_READ_OUTPUT_REG, addr, count, batch, prio, cb);
+}
+
+
+bool modbus_write(uint16_t addr, uint16_t value, modbus_prio_t prio,
+                  modbus_rw_cb_t cb) {
+  return _queue_push(MODBUS_WRITE_OUTPUT_REG, addr, value, false, prio, cb);
+}
+
+
+bool modbus_multi_write(uint16_t addr, uint16_t value, modbus_prio_t prio,
+                        modbus_rw_cb_t cb) {
+  return _queue_push(MODBUS_WRITE_OUTPUT_REGS, addr, value, false, prio, cb);
+}
+
+
+bool modbus_huanyang(huanyang_func_t func, uint8_t addr, uint16_t value,
+                     modbus_prio_t prio, modbus_rw_cb_t cb) {
+  return _queue_push(MODBUS_HUANYANG | func, addr, value, false, prio, cb);
+}
+
+
+/// Drop queued transactions, a response to one being sent is ignored
+void modbus_flush() {
+  queue.length = queue.sent = 0;
+}
+
+
+const modbus_transfer_t *modbus_get_transfer() {return &state.transfer;}
+
+
 void modbus_callback() {
   if (state.transmit_complete) {
     state.last_write = rtc_get_time();
@@ -448,6 +746,7 @@ void modbus_callback() {
   }
 
   _handle_response();
+  _queue_send();
   _start_write();
 
   // Timeout out writes
@@ -463,11 +762,10 @@ void modbus_callback() {
     format_hex_buf(received, state.response, state.bytes);
 
     STATUS_DEBUG("modbus: sent 0x%s received 0x%s expected %u bytes",
-                 sent, received, state.response_length);
+                 sent, received, state.expected);
   }
 
-  if (state.retry < 2 * MODBUS_RETRIES) _retry();
-  else _timeout();
+  _retry_or_timeout();
 }
 
 
@@ -482,6 +780,7 @@ uint8_t get_mb_baud() {return cfg.baud;}
 void set_mb_baud(uint8_t baud) {
   cfg.baud = (baud_t)baud;
   usart_set_baud(&RS485_PORT, cfg.baud);
+  _set_frame_timing();
 }
 
 
@@ -497,3 +796,4 @@ void set_mb_parity(uint8_t parity) {
 
 uint8_t get_mb_status() {return state.status;}
 uint16_t get_mb_crc_errs() {return state.crc_errs;}
+uint8_t get_mb_exception() {return state.exception;}
@@ -69,6 +69,14 @@
            regs: n-bytes  register values to write
        checksum: 16-bit   CRC: x^16 + x^15 + x^2 + 1 (0x8005) initial: 0xffff
 
+  Huanyang VFDs are not quite Modbus compliant.  Their message format is:
+
+           Send: [id][func][length][data][crc]
+        Receive: [id][func][length][data][crc]
+
+  Where length is the number of data bytes and func is one of
+  huanyang_func_t.  The CRC is the same as Modbus.
+
 \******************************************************************************/
 
 #pragma once
@@ -98,6 +106,32 @@ typedef enum {
 } modbus_base_addrs_t;
 
 
+// Queued transactions are sent highest priority first, in order otherwise
+typedef enum {
+  MODBUS_PRIO_POLL,    // Status polling
+  MODBUS_PRIO_CONTROL, // Setup, speed and direction, pre-empts polls
+} modbus_prio_t;
+
+
+// See Huanyang VFD manual pg56 3.1.3
+typedef enum {
+  HUANYANG_FUNC_READ = 1, // [len=1][addr] -> [len=3][addr][value]
+  HUANYANG_FUNC_WRITE,    // [len=3][addr][value] -> [len=3][addr][value]
+  HUANYANG_CTRL_WRITE,    // [len=1][ctrl] -> [len=1][status]
+  HUANYANG_CTRL_READ,     // [len=1][addr] -> [len=3][addr][value]
+  HUANYANG_FREQ_WRITE,    // [len=2][value] -> [len=2][value]
+} huanyang_func_t;
+
+
+// Result of the last request, valid during modbus_cb_t and modbus_rw_cb_t
+typedef struct {
+  uint32_t latency; // RTC counts from first send to a valid response
+  uint8_t retries;
+  uint8_t crc_errs;
+  bool timedout;
+} modbus_transfer_t;
+
+
 typedef void (*modbus_cb_t)(uint8_t func, uint8_t bytes, const uint8_t *data);
 typedef void (*modbus_rw_cb_t)(bool ok, uint16_t addr, uint16_t value);
 
@@ -106,7 +140,14 @@ void modbus_deinit();
 bool modbus_busy();
 void modbus_func(uint8_t func, uint8_t send, const uint8_t *data,
                  uint8_t receive, modbus_cb_t cb);
-void modbus_read(uint16_t addr, uint16_t count, modbus_rw_cb_t cb);
-void modbus_write(uint16_t addr, uint16_t value, modbus_rw_cb_t cb);
-void modbus_multi_write(uint16_t addr, uint16_t value, modbus_rw_cb_t cb);
+bool modbus_read(uint16_t addr, uint8_t count, bool batch, modbus_prio_t prio,
+                 modbus_rw_cb_t cb);
+bool modbus_write(uint16_t addr, uint16_t value, modbus_prio_t prio,
+                  modbus_rw_cb_t cb);
+bool modbus_multi_write(uint16_t addr, uint16_t value, modbus_prio_t prio,
+                        modbus_rw_cb_t cb);
+bool modbus_huanyang(huanyang_func_t func, uint8_t addr, uint16_t value,
+                     modbus_prio_t prio, modbus_rw_cb_t cb);
+void modbus_flush();
+const modbus_transfer_t *modbus_get_transfer();
 void modbus_callback();
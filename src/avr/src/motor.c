@@ -47,6 +47,14 @@
 #include <stdlib.h>
 
 
+typedef struct {
+  uint8_t shift;                 // log2 of microsteps per step pulse
+  uint8_t clock;
+  uint16_t timer_period;
+  int32_t steps;                 // microsteps output
+} motor_move_t;
+
+
 typedef struct {
   // Config
   uint8_t axis;                  // map motor to axis
@@ -58,6 +66,8 @@ typedef struct {
 
   bool slave;
   uint16_t microsteps;           // microsteps per full step
+  uint16_t coarse_microsteps;    // microsteps per full step at high speed
+  float coarse_velocity;         // m/min, use coarse microsteps above this
   bool reverse;
   bool enabled;
   float step_angle;              // degrees per whole step
@@ -68,20 +78,31 @@ typedef struct {
 
   // Computed
   float steps_per_unit;
+  uint8_t coarse_shift;          // log2(microsteps / coarse_microsteps)
+  float coarse_steps;            // microsteps per segment at coarse_velocity
 
   // Runtime state
   uint32_t power_timeout;
   int32_t commanded;
+  int32_t carry;                 // microsteps of commanded not yet output
+  int32_t steps;                 // microsteps output by the loaded move
   int32_t encoder;
   int16_t error;
   bool last_negative;
+  uint8_t shift;                 // log2 of microsteps per step pulse
+  uint8_t index_offset;          // driver indexer position minus encoder
+  uint8_t index_known;           // valid bits of index_offset
+  uint8_t index_shift;           // log2(256 / microsteps)
+  bool index_round;              // driver rounds the indexer on the next step
 
   // Move prep
   bool prepped;
-  uint8_t clock;
-  uint16_t timer_period;
   bool negative;
   int32_t position;
+  int32_t wanted;                // microsteps to output, with correction
+  motor_move_t move;             // move at the current step resolution
+  motor_move_t alt_move;         // move at the new step resolution
+  bool alt;                      // alt_move is valid
 } motor_t;
 
 
@@ -130,10 +151,45 @@ static void _update_config(int motor) {
   motor_t *m = &motors[motor];
 
   m->steps_per_unit = 360.0 * m->microsteps / m->travel_rev / m->step_angle;
+
+  m->coarse_shift = 0;
+  if (m->coarse_microsteps)
+    while ((m->coarse_microsteps << m->coarse_shift) < m->microsteps)
+      m->coarse_shift++;
+
+  m->coarse_steps = m->coarse_velocity * VELOCITY_MULTIPLIER *
+    m->steps_per_unit * SEGMENT_TIME;
+
+  m->index_shift = 0;
+  if (m->microsteps)
+    while ((m->microsteps << m->index_shift) < 256) m->index_shift++;
+
   _reset_encoder(motor);
 }
 
 
+/// Driver indexer position, in 1/256 steps modulo a full step, at a motor
+/// position
+static uint8_t _index(const motor_t &m, int32_t steps) {
+  return ((uint32_t)steps << m.index_shift) + m.index_offset;
+}
+
+
+/// True if the driver indexer position is known down to steps at the given
+/// resolution
+static bool _index_known(const motor_t &m, uint8_t shift) {
+  const uint8_t mask = (1 << (shift + m.index_shift)) - 1;
+  return !m.index_round && (m.index_known & mask) == mask;
+}
+
+
+/// True if the driver indexer is on a step at the given resolution
+static bool _index_aligned(const motor_t &m, uint8_t shift) {
+  const uint8_t mask = (1 << (shift + m.index_shift)) - 1;
+  return _index_known(m, shift) && !(_index(m, m.encoder) & mask);
+}
+
+
 void motor_init() {
   // Enable DMA
   DMA.CTRL = DMA_RESET_bm;
@@ -147,6 +203,9 @@ void motor_init() {
     m->min_soft_limit = -INFINITY;
     m->max_soft_limit = INFINITY;
 
+    // The drivers start at their home position
+    m->index_known = 0xff;
+
     _update_config(motor);
 
     // Setup motor timer
@@ -196,9 +255,21 @@ void motor_set_microstep(int motor, uint16_t value) {
 
   for (int m = motor; m < MOTORS; m++)
     if (motors[m].axis == motors[motor].axis) {
-      motors[m].microsteps = value;
+      motor_t &mo = motors[m];
+      bool changed = mo.microsteps != value;
+      uint8_t index = _index(mo, mo.encoder);
+
+      mo.microsteps = value;
       _update_config(m);
-      drv8711_set_microsteps(m, value);
+
+      if (changed) {
+        // The indexer position carries over to the new mode, which rounds it
+        // on the next step if it is not on a step of the mode
+        mo.index_offset = index - ((uint32_t)mo.encoder << mo.index_shift);
+        mo.index_round = index & ((1 << mo.index_shift) - 1);
+        mo.shift = 0;
+        drv8711_set_microsteps(m, value);
+      }
     }
 }
 
@@ -210,7 +281,11 @@ static int32_t _position_to_steps(int motor, float position) {
 
 void motor_set_position(int motor, float position) {
   motor_t *m = &motors[motor];
-  m->commanded = m->encoder = m->position = _position_to_steps(motor, position);
+  int32_t steps = _position_to_steps(motor, position);
+
+  m->index_offset += (uint32_t)(m->encoder - steps) << m->index_shift;
+  m->commanded = m->encoder = m->position = steps;
+  m->carry = m->steps = m->wanted = 0;
   m->error = 0;
 }
 
@@ -221,6 +296,7 @@ float motor_get_soft_limit(int motor, bool min) {
 
 
 bool motor_get_homed(int motor) {return motors[motor].homed;}
+int16_t motor_get_error(int motor) {return motors[motor].error;}
 
 
 void motor_set_step_output(int motor, bool enabled) {
@@ -252,9 +328,17 @@ stat_t motor_rtc_callback() { // called by controller
 }
 
 
-void motor_emulate_steps(int motor) {
+/// Emulate the DMA step count.  Up to lost pulses are dropped from a newly
+/// loaded move to simulate missed steps.  Returns the pulses dropped.
+uint16_t motor_emulate_steps(int motor, uint16_t lost) {
   motor_t *m = &motors[motor];
-  m->dma->TRFCNT = 0xffff - abs(m->commanded - m->encoder);
+  uint16_t pulses = labs(m->steps) >> m->shift;
+
+  if (m->dma->TRFCNT != 0xffff || !pulses) return 0; // Already counted
+  if (pulses < lost) lost = pulses;
+
+  m->dma->TRFCNT = 0xffff - (pulses - lost);
+  return lost;
 }
 
 
@@ -269,12 +353,20 @@ void motor_end_move(int motor) {
   // Wait for pending DMA transfers
   while (m.dma->CTRLB & DMA_CH_CHPEND_bm) continue;
 
-  // Get actual step count from DMA channel
-  const int32_t steps = 0xffff - m.dma->TRFCNT;
+  // Get actual step count from DMA channel, in microsteps
+  const int32_t steps = (int32_t)(0xffff - m.dma->TRFCNT) << m.shift;
 
-  // Accumulate encoder & compute error
+  // Accumulate encoder & compute error, excluding microsteps not yet output
   m.encoder += m.last_negative ? -steps : steps;
-  m.error = m.commanded - m.encoder;
+
+  // The driver rounded the indexer, in an unknown direction, to a step
+  if (m.index_round && steps) {
+    const uint8_t mask = (1 << m.index_shift) - 1;
+    m.index_offset &= ~mask;
+    m.index_known = mask;
+    m.index_round = false;
+  }
+  m.error = m.commanded - m.carry - m.encoder;
 }
 
 
@@ -287,7 +379,20 @@ void motor_load_move(int motor) {
 
   motor_end_move(motor);
 
-  if (!m.timer_period) return; // Leave clock stopped
+  // Change step resolution only if the indexer is on a step of the new
+  // resolution.  The clock is stopped so the driver mode changes between
+  // steps.
+  const motor_move_t &move =
+    m.alt && _index_aligned(m, m.alt_move.shift) &&
+    drv8711_sync_microsteps(motor, m.microsteps >> m.alt_move.shift) ?
+    m.alt_move : m.move;
+
+  m.shift = move.shift;
+  m.commanded = m.position;
+  m.carry = m.wanted - move.steps;
+  m.steps = move.steps;
+
+  if (!move.timer_period) return; // Leave clock stopped
 
   // Set direction, compensating for polarity but only when moving
   const bool dir = m.negative ^ m.reverse;
@@ -308,48 +413,41 @@ void motor_load_move(int motor) {
   // updates immediately and possibly mid step.
 
   // Set clock and period
-  m.timer->CTRLA  = m.clock;         // Start clock
-  m.timer->PERBUF = m.timer_period;  // Set next frequency
+  m.timer->CTRLA  = move.clock;         // Start clock
+  m.timer->PERBUF = move.timer_period;  // Set next frequency
   m.last_negative = m.negative;
-  m.commanded     = m.position;
 }
 
 
-void motor_prep_move(int motor, float target) {
-  // Validate input
-  ESTOP_ASSERT(0 <= motor && motor < MOTORS, STAT_MOTOR_ID_INVALID);
-  ESTOP_ASSERT(isfinite(target), STAT_BAD_FLOAT);
+/// Stop short of the move's target so it ends on a step of the coarser
+/// resolution given by shift.  Moves too short to reach one are unchanged.
+static int32_t _align_steps(const motor_t &m, int32_t steps, uint8_t shift) {
+  const uint16_t mask = (1 << shift) - 1;
+  const uint16_t past =
+    (_index(m, m.encoder + m.steps + steps) >> m.index_shift) & mask;
 
-  motor_t &m = motors[motor];
-  ESTOP_ASSERT(!m.prepped, STAT_MOTOR_NOT_READY);
+  int32_t aligned;
+  if (steps < 0) aligned = steps + (past ? mask + 1 - past : 0);
+  else aligned = steps - past;
 
-  // Travel in steps
-  int32_t position = _position_to_steps(motor, target);
-  int24_t steps = position - m.position;
-  m.position = position;
+  return (aligned < 0) == (steps < 0) && aligned ? aligned : steps;
+}
 
-  // Error correction
-  int16_t correction = abs(m.error);
-  if (MIN_STEP_CORRECTION <= correction) {
-    // Dampen correction oscillation
-    correction >>= 1;
 
-    // Make correction
-    steps += m.error < 0 ? -correction : correction;
-  }
+static void _plan_move(motor_move_t &move, int32_t steps, uint8_t shift) {
+  // Whole step pulses only, the remainder is left for the next move
+  const int32_t pulses = labs(steps) >> shift;
 
-  // Positive steps from here on
-  m.negative = steps < 0;
-  if (m.negative) steps = -steps;
+  move.shift = shift;
 
   // Start with clock / 2
   const float seg_clocks = SEGMENT_TIME * (F_CPU * 60 / 2);
-  float ticks_per_step = seg_clocks / steps;
+  float ticks_per_step = seg_clocks / pulses;
 
   // Use faster clock with faster step rates for increased resolution.
   if (ticks_per_step < 0x7fff) {
     ticks_per_step *= 2;
-    m.clock = TC_CLKSEL_DIV1_gc;
+    move.clock = TC_CLKSEL_DIV1_gc;
 
     // Limit clock if step rate is too fast
     // We allow a slight fudge here (i.e. 1.9 instead 2) because the motor
@@ -358,21 +456,79 @@ void motor_prep_move(int motor, float target) {
     if (ticks_per_step < STEP_PULSE_WIDTH * 1.9)
       ticks_per_step = STEP_PULSE_WIDTH * 1.9; // Too fast
 
-  } else m.clock = TC_CLKSEL_DIV2_gc; // NOTE, pulse width will be twice as long
+  } else move.clock = TC_CLKSEL_DIV2_gc; // NOTE, pulse width will be doubled
 
   // Disable clock if too slow
   if (0xffff <= ticks_per_step) ticks_per_step = 0;
 
-  m.timer_period = steps ? round(ticks_per_step) : 0;
+  move.timer_period = pulses ? round(ticks_per_step) : 0;
+  if (!move.timer_period) move.steps = 0;
+  else move.steps = (steps < 0 ? -pulses : pulses) * (1 << shift);
+}
+
+
+void motor_prep_move(int motor, float target) {
+  // Validate input
+  ESTOP_ASSERT(0 <= motor && motor < MOTORS, STAT_MOTOR_ID_INVALID);
+  ESTOP_ASSERT(isfinite(target), STAT_BAD_FLOAT);
+
+  motor_t &m = motors[motor];
+  ESTOP_ASSERT(!m.prepped, STAT_MOTOR_NOT_READY);
+
+  // Travel in microsteps from the end of the loaded move, plus the microsteps
+  // it leaves for later moves
+  int32_t position = _position_to_steps(motor, target);
+  int32_t steps = position - m.commanded + m.carry;
+  int32_t travel = labs(position - m.position);
+  m.position = position;
+
+  // Error correction
+  int16_t correction = abs(m.error);
+  if (MIN_STEP_CORRECTION <= correction) {
+    // Dampen correction oscillation
+    correction >>= 1;
+
+    // Make correction
+    steps += m.error < 0 ? -correction : correction;
+  }
+
+  m.negative = steps < 0;
+  m.wanted = steps;
+
+  // Use coarse microsteps at high speed, with some hysteresis.  Slowing
+  // below one coarse step per segment always switches back so that moves end
+  // at full resolution.
+  uint8_t shift = 0;
+  if (m.coarse_shift && m.coarse_steps && _index_known(m, m.coarse_shift)) {
+    float limit = m.coarse_steps * (m.shift ? MICROSTEP_HYSTERESIS : 1);
+    if (limit < travel && (1 << m.coarse_shift) < travel)
+      shift = m.coarse_shift;
+  }
+
+  // Plan moves with and without a resolution change, one is chosen on load
+  m.alt = shift != m.shift;
+  if (m.alt) {
+    _plan_move(m.alt_move, steps, shift);
+    if (m.shift < shift) steps = _align_steps(m, steps, shift);
+  }
+
+  _plan_move(m.move, steps, m.shift);
 
   // Power motor
   if (!m.enabled) {
-    m.timer_period = 0;
+    m.alt = false;
+    m.move.timer_period = 0;
+    m.move.steps = m.wanted = 0;
+    m.index_offset += (uint32_t)(m.encoder - m.position) << m.index_shift;
     m.encoder = m.commanded = m.position;
+    m.carry = m.steps = 0;
     m.error = 0;
+  }
 
-  } else if (m.timer_period) // Motor is moving so reset power timeout
-    m.power_timeout = rtc_get_time() + MOTOR_IDLE_TIMEOUT * 1000;
+  // Motor is moving so reset power timeout
+  const bool moving = m.move.timer_period;
+  if (moving) m.power_timeout = rtc_get_time() + MOTOR_IDLE_TIMEOUT * 1000;
+  drv8711_set_accel_phase(motor, moving ? exec_get_accel_phase() : 0);
   _update_power(motor);
 
   // Queue move
@@ -429,6 +585,42 @@ void set_microstep(int motor, uint16_t value) {
 }
 
 
+uint16_t get_coarse_microstep(int motor) {
+  return motors[motor].coarse_microsteps;
+}
+
+
+void set_coarse_microstep(int motor, uint16_t value) {
+  switch (value) {
+  case 0: case 1: case 2: case 4: case 8: case 16: case 32: case 64: case 128:
+    break;
+  default: return;
+  }
+
+  if (motors[motor].slave) return;
+
+  for (int m = motor; m < MOTORS; m++)
+    if (motors[m].axis == motors[motor].axis) {
+      motors[m].coarse_microsteps = value;
+      _update_config(m);
+    }
+}
+
+
+float get_coarse_velocity(int motor) {return motors[motor].coarse_velocity;}
+
+
+void set_coarse_velocity(int motor, float value) {
+  if (motors[motor].slave) return;
+
+  for (int m = motor; m < MOTORS; m++)
+    if (motors[m].axis == motors[motor].axis) {
+      motors[m].coarse_velocity = value;
+      _update_config(m);
+    }
+}
+
+
 char get_motor_axis(int motor) {return motors[motor].axis;}
 
 
@@ -447,6 +639,8 @@ void set_motor_axis(int motor, uint8_t axis) {
       set_step_angle(motor, motors[m].step_angle);
       set_travel(motor, motors[m].travel_rev);
       set_microstep(motor, motors[m].microsteps);
+      set_coarse_microstep(motor, motors[m].coarse_microsteps);
+      set_coarse_velocity(motor, motors[m].coarse_velocity);
       set_motor_enabled(motor, motors[m].enabled);
       motors[motor].slave = true; // Must be last
       break;
@@ -51,6 +51,7 @@ void motor_set_microstep(int motor, uint16_t value);
 void motor_set_position(int motor, float position);
 float motor_get_soft_limit(int motor, bool min);
 bool motor_get_homed(int motor);
+int16_t motor_get_error(int motor);
 void motor_set_step_output(int motor, bool enabled);
 
 stat_t motor_rtc_callback();
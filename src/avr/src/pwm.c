@@ -30,6 +30,7 @@
 #include "config.h"
 #include "estop.h"
 #include "outputs.h"
+#include "util.h"
 
 #include <math.h>
 
@@ -40,6 +41,7 @@ typedef struct {
   float min_duty;
   float max_duty;
   float power;
+  float duty_lut[POWER_LUT]; // Power correction vs. power, 0 is linear
 } pwm_t;
 
 
@@ -84,6 +86,8 @@ static void _update_clock(uint16_t period) {
 static float _compute_duty(float power) {
   power = fabsf(power);
   if (!power) return 0; // 0% duty
+  power *= 1 + lut_interp(pwm.duty_lut, POWER_LUT, power);
+  if (1 < power) power = 1;
   if (power == 1 && pwm.max_duty == 1) return 1; // 100% duty
   return power * (pwm.max_duty - pwm.min_duty) + pwm.min_duty;
 }
@@ -200,6 +204,15 @@ void set_pwm_max_duty(float value) {
 }
 
 
+float get_power_duty_corr(int index) {return (1 + pwm.duty_lut[index]) * 100;}
+
+
+void set_power_duty_corr(int index, float value) {
+  pwm.duty_lut[index] = value * 0.01 - 1;
+  _update_pwm();
+}
+
+
 float get_pwm_duty() {return _compute_duty(pwm.power);}
 float get_pwm_freq() {return pwm.freq;}
 
@@ -33,22 +33,31 @@
 
 
 static bool _full = false;
-static uint32_t _last = 0;
+static uint32_t _last[REPORT_CHANGE];
 
 
 void report_request_full() {_full = true;}
 
 
+static uint8_t _due(report_class_t rc, uint16_t rate, uint32_t now) {
+  if (!_full && now - _last[rc] < rate) return 0;
+  _last[rc] = now;
+  return 1 << rc;
+}
+
+
 void report_callback() {
   // Wait until output buffer is empty
   if (!usart_tx_empty()) return;
 
-  // Limit frequency
+  // Each class runs at its own rate, changes are checked every pass
   uint32_t now = rtc_get_time();
-  if (now - _last < REPORT_RATE) return;
-  _last = now;
+  uint8_t classes = 1 << REPORT_CHANGE;
+  classes |= _due(REPORT_FAST, REPORT_RATE_FAST, now);
+  classes |= _due(REPORT_NORMAL, REPORT_RATE, now);
+  classes |= _due(REPORT_SLOW, REPORT_RATE_SLOW, now);
 
   // Report vars
-  vars_report(_full);
+  vars_report(classes, _full);
   _full = false;
 }
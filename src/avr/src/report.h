@@ -30,5 +30,16 @@
 
 #include "status.h"
 
+
+// Var report classes, see vars.def
+typedef enum {
+  REPORT_OFF,
+  REPORT_NORMAL,   // Every REPORT_RATE
+  REPORT_FAST,     // Every REPORT_RATE_FAST
+  REPORT_SLOW,     // Every REPORT_RATE_SLOW
+  REPORT_CHANGE,   // As soon as it changes
+} report_class_t;
+
+
 void report_request_full();
 void report_callback();
@@ -30,13 +30,15 @@
 #include "switch.h"
 #include "analog.h"
 #include "motor.h"
+#include "drv8711.h"
 #include "lcd.h"
-#include "vfd_spindle.h"
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <avr/wdt.h>
 
+#include <util/atomic.h>
+
 #include <string.h>
 
 
@@ -49,8 +51,8 @@ ISR(RTC_OVF_vect) {
   lcd_rtc_callback();
   switch_rtc_callback();
   analog_rtc_callback();
-  vfd_spindle_rtc_callback();
   if (!(ticks & 255)) motor_rtc_callback();
+  drv8711_rtc_callback();
   wdt_reset();
 }
 
@@ -68,11 +70,31 @@ void rtc_init() {
   while (RTC.STATUS & RTC_SYNCBUSY_bm);               // wait RTC not busy
 
   // the following must be in this order or it doesn't work
-  RTC.PER = 33;                        // overflow period ~1ms
+  RTC.PER = RTC_PERIOD - 1;            // overflow period ~1ms
   RTC.INTCTRL = RTC_OVFINTLVL_LO_gc;   // overflow LO interrupt
   RTC.CTRL = RTC_PRESCALER_DIV1_gc;    // no prescale
 }
 
 
 uint32_t rtc_get_time() {return ticks;}
+
+
+/// Time in RTC counts with sub-tick resolution
+uint32_t rtc_get_counts() {
+  uint32_t t;
+  uint16_t cnt;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    t = ticks;
+    cnt = RTC.CNT;
+
+    // Account for an overflow not yet handled
+    if (RTC.INTFLAGS & RTC_OVFIF_bm) {
+      t++;
+      cnt = RTC.CNT;
+    }
+  }
+
+  return t * RTC_PERIOD + cnt;
+}
 bool rtc_expired(uint32_t t) {return 0 <= (int32_t)(ticks - t);}
@@ -31,7 +31,15 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+
+#define RTC_PERIOD 34      // RTC counts per tick
+#ifndef RTC_FREQ
+#define RTC_FREQ   32768   // RTC counts per second
+#endif
+
+
 void rtc_init();
 uint32_t rtc_get_time();
+uint32_t rtc_get_counts();
 int32_t rtc_diff(uint32_t t);
 bool rtc_expired(uint32_t t);
@@ -0,0 +1,293 @@
+/******************************************************************************\
+
+                  This file is part of the Buildbotics firmware.
+
+         Copyright (c) 2015 - 2021, Buildbotics LLC, All rights reserved.
+
+          This Source describes Open Hardware and is licensed under the
+                                  CERN-OHL-S v2.
+
+          You may redistribute and modify this Source and make products
+     using it under the terms of the CERN-OHL-S v2 (https:/cern.ch/cern-ohl).
+            This Source is distributed WITHOUT ANY EXPRESS OR IMPLIED
+     WARRANTY, INCLUDING OF MERCHANTABILITY, SATISFACTORY QUALITY AND FITNESS
+      FOR A PARTICULAR PURPOSE. Please see the CERN-OHL-S v2 for applicable
+                                   conditions.
+
+                 Source location: https://github.com/buildbotics
+
+       As per CERN-OHL-S v2 section 4, should You produce hardware based on
+     these sources, You must maintain the Source Location clearly visible on
+     the external case of the CNC Controller or other product you make using
+                                   this Source.
+
+                 For more information, email info@buildbotics.com
+
+\******************************************************************************/
+
+#include "scope.h"
+
+#include "config.h"
+#include "axis.h"
+#include "motor.h"
+#include "stepper.h"
+#include "switch.h"
+#include "usart.h"
+#include "type.h"
+
+#include <avr/pgmspace.h>
+
+#include <stdlib.h>
+#include <ctype.h>
+#include <stdio.h>
+
+
+uint16_t get_id();
+
+
+typedef enum {
+  SCOPE_OFF,
+  SCOPE_ARMED,
+  SCOPE_TRIGGERED,
+  SCOPE_DONE,
+  SCOPE_DUMPING,
+} scope_state_t;
+
+
+typedef enum {
+  SCOPE_TRIGGER_NOW = 'n',
+  SCOPE_TRIGGER_ID = 'i',
+  SCOPE_TRIGGER_SWITCH = 's',
+  SCOPE_TRIGGER_ESTOP = 'e',
+} scope_trigger_t;
+
+
+typedef struct {
+  float vel;
+  float accel;
+  float jerk;
+  float position[SCOPE_AXES];
+  int16_t error[MOTORS];
+  float power;
+  uint16_t slack;
+} scope_sample_t;
+
+
+static struct {
+  volatile scope_state_t state;
+  scope_trigger_t trigger;
+  uint16_t arg;
+  bool active;                  // Switch state when armed
+  int8_t axes[SCOPE_AXES];
+  char names[SCOPE_AXES + 1];
+  float power;                  // Last power update
+
+  uint8_t head;                 // Next sample to write
+  uint8_t count;                // Samples in buffer
+  uint8_t remaining;            // Samples left to capture after trigger
+  uint8_t trigger_at;           // Buffer index of trigger sample
+  int16_t dump;                 // Next sample to dump, -1 for header
+
+  scope_sample_t samples[SCOPE_SAMPLES];
+} scope = {SCOPE_OFF};
+
+
+static uint8_t _index(uint8_t i) {
+  return (scope.head + SCOPE_SAMPLES - scope.count + i) % SCOPE_SAMPLES;
+}
+
+
+static bool _triggered() {
+  switch (scope.trigger) {
+  case SCOPE_TRIGGER_NOW: return true;
+  case SCOPE_TRIGGER_ID: return 0 <= (int16_t)(get_id() - scope.arg);
+  case SCOPE_TRIGGER_SWITCH:
+    return switch_is_active((switch_id_t)scope.arg) != scope.active;
+  case SCOPE_TRIGGER_ESTOP: break; // See scope_estop()
+  }
+
+  return false;
+}
+
+
+static void _trigger(uint8_t index) {
+  scope.trigger_at = index;
+  scope.remaining = SCOPE_SAMPLES - SCOPE_PRETRIGGER;
+  scope.state = SCOPE_TRIGGERED;
+}
+
+
+/// Called from the LO interrupt once per segment.  Values are recorded in
+/// internal units and converted when dumped to keep the ISR short.
+void scope_sample(float vel, float accel, float jerk, const float position[],
+                  const power_update_t powers[]) {
+  for (int i = 0; i < POWER_MAX_UPDATES; i++)
+    if (powers[i].state != POWER_IGNORE) {
+      scope.power = powers[i].power;
+      break;
+    }
+
+  if (scope.state != SCOPE_ARMED && scope.state != SCOPE_TRIGGERED) return;
+
+  scope_sample_t &s = scope.samples[scope.head];
+  s.vel = vel;
+  s.accel = accel;
+  s.jerk = jerk;
+  for (int i = 0; i < SCOPE_AXES; i++)
+    s.position[i] = position[scope.axes[i]];
+  for (int motor = 0; motor < MOTORS; motor++)
+    s.error[motor] = motor_get_error(motor);
+  s.power = scope.power;
+  s.slack = st_get_slack();
+
+  uint8_t index = scope.head;
+  scope.head = (scope.head + 1) % SCOPE_SAMPLES;
+
+  if (scope.count < SCOPE_SAMPLES) scope.count++;
+
+  if (scope.state == SCOPE_ARMED) {
+    if (_triggered()) _trigger(index);
+
+    // Keep at most SCOPE_PRETRIGGER samples before the trigger.  An estop
+    // trigger keeps the whole buffer as history.
+    else if (scope.trigger != SCOPE_TRIGGER_ESTOP &&
+             SCOPE_PRETRIGGER < scope.count) scope.count = SCOPE_PRETRIGGER;
+  }
+
+  if (scope.state == SCOPE_TRIGGERED && !--scope.remaining)
+    scope.state = SCOPE_DONE;
+}
+
+
+/// Motion stopped, end a triggered capture early
+void scope_idle() {
+  if (scope.state == SCOPE_TRIGGERED) scope.state = SCOPE_DONE;
+}
+
+
+/// Freeze the capture, the last sample taken is the trigger
+void scope_estop() {
+  if (scope.state == SCOPE_ARMED)
+    _trigger((scope.head + SCOPE_SAMPLES - 1) % SCOPE_SAMPLES);
+
+  if (scope.state == SCOPE_TRIGGERED) scope.state = SCOPE_DONE;
+}
+
+
+static void _dump_header() {
+  uint8_t trigger = scope.count ? (scope.trigger_at + SCOPE_SAMPLES -
+                                   _index(0)) % SCOPE_SAMPLES : 0;
+
+  printf_P(PSTR("\n{\"scope\":{\"axes\":\"%s\",\"motors\":%d,"
+                "\"period\":%d,\"samples\":%d,\"trigger\":%d}}\n"),
+           scope.names, MOTORS, SEGMENT_MS, scope.count, trigger);
+}
+
+
+static void _dump_sample(const scope_sample_t &s) {
+  printf_P(PSTR("{\"scope\":["));
+  type_print_f32(s.vel / VELOCITY_MULTIPLIER);
+  putchar(',');
+  type_print_f32(s.accel / ACCEL_MULTIPLIER);
+  putchar(',');
+  type_print_f32(s.jerk / JERK_MULTIPLIER);
+
+  for (int i = 0; i < SCOPE_AXES; i++) {
+    putchar(',');
+    type_print_f32(s.position[i]);
+  }
+
+  for (int motor = 0; motor < MOTORS; motor++)
+    printf_P(PSTR(",%d"), s.error[motor]);
+
+  putchar(',');
+  type_print_f32(s.power);
+  printf_P(PSTR(",%u]}\n"), s.slack);
+}
+
+
+/// Stream one line of the dump per call so the main loop is not held up
+void scope_callback() {
+  if (scope.state != SCOPE_DUMPING || !usart_tx_empty()) return;
+
+  if (scope.dump < 0) _dump_header();
+  else if (scope.dump < scope.count)
+    _dump_sample(scope.samples[_index(scope.dump)]);
+
+  else {
+    printf_P(PSTR("{\"scope\":\"end\"}\n"));
+    scope.state = SCOPE_OFF;
+    return;
+  }
+
+  scope.dump++;
+}
+
+
+static stat_t _arm(char *cmd) {
+  scope.state = SCOPE_OFF;
+
+  for (int i = 0; i < SCOPE_AXES; i++) {
+    int axis = axis_get_id(*cmd);
+    if (axis < 0 || AXES <= axis) return STAT_INVALID_ARGUMENTS;
+    scope.axes[i] = axis;
+    scope.names[i] = tolower(*cmd++);
+  }
+
+  scope_trigger_t trigger = (scope_trigger_t)*cmd++;
+  char *end = cmd;
+  long arg = strtol(cmd, &end, 0);
+  if (*end) return STAT_INVALID_ARGUMENTS;
+
+  switch (trigger) {
+  case SCOPE_TRIGGER_NOW: case SCOPE_TRIGGER_ESTOP: break;
+  case SCOPE_TRIGGER_ID: if (end == cmd) return STAT_TOO_FEW_ARGUMENTS; break;
+
+  case SCOPE_TRIGGER_SWITCH:
+    if (end == cmd) return STAT_TOO_FEW_ARGUMENTS;
+    if (arg < 0 || SW_MOTOR_FAULT < arg) return STAT_INVALID_ARGUMENTS;
+    scope.active = switch_is_active((switch_id_t)arg);
+    break;
+
+  default: return STAT_INVALID_ARGUMENTS;
+  }
+
+  scope.trigger = trigger;
+  scope.arg = arg;
+  scope.head = scope.count = 0;
+  scope.state = SCOPE_ARMED;
+
+  return STAT_OK;
+}
+
+
+// Var callbacks
+PGM_P get_scope_state() {
+  switch (scope.state) {
+  case SCOPE_OFF:       return PSTR("off");
+  case SCOPE_ARMED:     return PSTR("armed");
+  case SCOPE_TRIGGERED: return PSTR("triggered");
+  case SCOPE_DONE:      return PSTR("done");
+  case SCOPE_DUMPING:   return PSTR("dumping");
+  }
+
+  return PSTR("invalid");
+}
+
+
+// Command callbacks
+stat_t command_scope(char *cmd) {
+  switch (cmd[1]) {
+  case 'a': return _arm(cmd + 2);
+
+  case 'd':
+    if (scope.state != SCOPE_DONE) return STAT_INVALID_COMMAND;
+    scope.dump = -1;
+    scope.state = SCOPE_DUMPING;
+    return STAT_OK;
+
+  case 'c': scope.state = SCOPE_OFF; return STAT_OK;
+  }
+
+  return STAT_INVALID_ARGUMENTS;
+}
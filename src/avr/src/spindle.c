@@ -27,13 +27,17 @@
 
 #include "spindle.h"
 #include "pwm.h"
-#include "huanyang.h"
 #include "vfd_spindle.h"
 #include "stepper.h"
 #include "config.h"
 #include "command.h"
 #include "exec.h"
 #include "util.h"
+#include "rtc.h"
+#include "state.h"
+#include "estop.h"
+
+#include <util/atomic.h>
 
 #include <math.h>
 
@@ -56,6 +60,7 @@ static struct {
 
   bool dynamic_power;
   float inv_feed;
+  float vel_lut[POWER_LUT]; // Power correction vs. velocity, 0 is linear
 
   spindle_type_t next_type;
 
@@ -66,11 +71,51 @@ static struct {
 };
 
 
+// Speed change lead tracking.  Motion time queued ahead of each speed change
+// is counted down as it executes so the change can be sent to the VFD early
+// enough for the spindle to be up to speed when the change is reached.
+typedef struct {
+  float ahead;  // Queued motion time before the change, mins
+  float lead;   // Time the spindle needs to reach the speed, mins
+  float speed;
+  bool barrier; // Stop, reversal or command of unknown duration, later
+                // changes must wait
+  bool applied;
+} speed_lead_t;
+
+
+static struct {
+  float up;          // Spin up rate, RPM/sec
+  float down;        // Spin down rate, RPM/sec
+  float speed;       // Speed after the last queued change
+  float queued;      // Motion time queued, mins
+  float move_time;   // Time of the last queued move, mins
+  float move_length; // Length of the last queued move, mm
+
+  speed_lead_t fifo[SPINDLE_LEADS];
+  uint8_t head;
+  uint8_t fill;
+  uint16_t untracked; // Queued changes and barriers not in the FIFO
+} lead;
+
+
+typedef struct {
+  float tolerance; // Fraction of target speed
+  float timeout;   // Seconds, zero waits forever
+} at_speed_t;
+
+
+static struct {
+  float tolerance;
+  bool timed;
+  uint32_t timeout;
+} at_speed;
+
+
 static float _get_power() {
   switch (spindle.type) {
   case SPINDLE_TYPE_DISABLED: return 0;
   case SPINDLE_TYPE_PWM:      return pwm_get();
-  case SPINDLE_TYPE_HUANYANG: return huanyang_get();
   default:                    return vfd_spindle_get();
   }
 }
@@ -103,7 +148,6 @@ static void _set_speed(float speed) {
     break;
   }
 
-  case SPINDLE_TYPE_HUANYANG: huanyang_set(power); break;
   default: vfd_spindle_set(power); break;
   }
 }
@@ -116,7 +160,6 @@ static void _deinit_cb() {
   switch (spindle.type) {
   case SPINDLE_TYPE_DISABLED:                     break;
   case SPINDLE_TYPE_PWM:      pwm_init();         break;
-  case SPINDLE_TYPE_HUANYANG: huanyang_init();    break;
   default:                    vfd_spindle_init(); break;
   }
 
@@ -134,7 +177,6 @@ static void _set_type(spindle_type_t type) {
   switch (old_type) {
   case SPINDLE_TYPE_DISABLED: _deinit_cb();                   break;
   case SPINDLE_TYPE_PWM:      pwm_deinit(_deinit_cb);         break;
-  case SPINDLE_TYPE_HUANYANG: huanyang_deinit(_deinit_cb);    break;
   default:                    vfd_spindle_deinit(_deinit_cb); break;
   }
 }
@@ -143,6 +185,107 @@ static void _set_type(spindle_type_t type) {
 spindle_type_t spindle_get_type() {return spindle.type;}
 
 
+static bool _lead_enabled() {
+  return spindle.type != SPINDLE_TYPE_DISABLED &&
+    spindle.type != SPINDLE_TYPE_PWM && (lead.up || lead.down);
+}
+
+
+static float _lead_time(float from, float to) {
+  // Never stop or reverse the spindle while the cut is still running
+  if (!to || from * to < 0) return 0;
+
+  float change = fabs(to) - fabs(from);
+  float rate = 0 < change ? lead.up : lead.down;
+
+  return rate ? fabs(change) / rate / 60 : 0; // mins
+}
+
+
+static speed_lead_t &_lead_at(uint8_t i) {
+  return lead.fifo[(lead.head + i) % SPINDLE_LEADS];
+}
+
+
+static void _lead_push(float speed, float early, bool barrier) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    // Tracked entries must all precede untracked ones
+    if (lead.untracked || lead.fill == SPINDLE_LEADS || !_lead_enabled())
+      lead.untracked++;
+
+    else {
+      speed_lead_t &l = _lead_at(lead.fill++);
+      l.ahead = lead.queued - early;
+      l.lead = barrier ? 0 : _lead_time(lead.speed, speed);
+      l.speed = speed;
+      // Stops and reversals also hold back later changes
+      l.barrier = barrier || !speed || lead.speed * speed < 0;
+      l.applied = false;
+    }
+  }
+
+  if (!barrier) lead.speed = speed;
+}
+
+
+// Pop executing change or barrier, returns true if it was already applied
+static bool _lead_pop() {
+  if (!lead.fill) {
+    if (lead.untracked) lead.untracked--;
+    return false;
+  }
+
+  bool applied = lead.fifo[lead.head].applied;
+  lead.head = (lead.head + 1) % SPINDLE_LEADS;
+  lead.fill--;
+
+  return applied;
+}
+
+
+void spindle_queue_move(float time, float length) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) lead.queued += time;
+  lead.move_time = time;
+  lead.move_length = length;
+}
+
+
+void spindle_queue_barrier() {_lead_push(0, 0, true);}
+void spindle_barrier_done() {_lead_pop();}
+
+
+// Called from lo-priority stepper interrupt as queued motion executes
+void spindle_advance(float time) {
+  lead.queued = lead.queued < time ? 0 : lead.queued - time;
+
+  int apply = -1;
+  bool blocked = false;
+
+  for (uint8_t i = 0; i < lead.fill; i++) {
+    speed_lead_t &l = _lead_at(i);
+    l.ahead -= time;
+
+    if (l.barrier) blocked = true;
+    else if (!blocked && !l.applied && l.lead && l.ahead <= l.lead) apply = i;
+  }
+
+  if (apply < 0) return;
+
+  // Apply in order, skipping intermediate speeds
+  for (int i = 0; i <= apply; i++) _lead_at(i).applied = true;
+  _set_speed(_lead_at(apply).speed);
+}
+
+
+void spindle_reset_queue() {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    lead.head = lead.fill = lead.untracked = 0;
+    lead.queued = lead.move_time = lead.move_length = 0;
+    lead.speed = spindle.speed;
+  }
+}
+
+
 static power_update_t _get_power_update() {
   float power = _speed_to_power(spindle.speed);
 
@@ -150,7 +293,11 @@ static power_update_t _get_power_update() {
   if (spindle.type == SPINDLE_TYPE_PWM && spindle.dynamic_power &&
       spindle.inv_feed) {
     float scale = spindle.inv_feed * exec_get_velocity();
-    if (scale < 1) power *= scale;
+    if (scale < 1) {
+      power *= scale * (1 + lut_interp(spindle.vel_lut, POWER_LUT, scale));
+      if (1 < power) power = 1;
+      else if (power < -1) power = -1;
+    }
   }
 
   return pwm_get_update(power);
@@ -168,9 +315,16 @@ void spindle_load_power_updates(power_update_t updates[], float minD,
 
     while (true) {
       // Load new sync speed if needed and available
-      if (spindle.sync_speed.dist < 0 && command_peek() == COMMAND_sync_speed)
+      if (spindle.sync_speed.dist < 0 && command_peek() == COMMAND_sync_speed) {
         spindle.sync_speed = *(sync_speed_t *)(command_next() + 1);
 
+        // Skip speeds already applied ahead of time
+        if (_lead_pop()) {
+          spindle.sync_speed.dist = -1;
+          continue;
+        }
+      }
+
       // Exit if we don't have a speed or it's not ready to be set
       if (spindle.sync_speed.dist == -1 || d < spindle.sync_speed.dist) break;
 
@@ -251,7 +405,6 @@ uint16_t get_spindle_status() {
   switch (spindle.type) {
   case SPINDLE_TYPE_DISABLED: return 0;
   case SPINDLE_TYPE_PWM:      return 0;
-  case SPINDLE_TYPE_HUANYANG: return huanyang_get_status();
   default:                    return vfd_get_status();
   }
 }
@@ -281,6 +434,16 @@ void set_dynamic_power(bool enable) {
 }
 
 
+float get_power_vel_corr(int index) {
+  return (1 + spindle.vel_lut[index]) * 100;
+}
+
+
+void set_power_vel_corr(int index, float value) {
+  spindle.vel_lut[index] = value * 0.01 - 1;
+}
+
+
 float get_inverse_feed() {return spindle.inv_feed;}
 
 
@@ -292,6 +455,12 @@ void set_inverse_feed(float iF) {
 }
 
 
+float get_spin_up() {return lead.up;}
+void set_spin_up(float value) {lead.up = value < 0 ? 0 : value;}
+float get_spin_down() {return lead.down;}
+void set_spin_down(float value) {lead.down = value < 0 ? 0 : value;}
+
+
 // Command callbacks
 stat_t command_sync_speed(char *cmd) {
   sync_speed_t s;
@@ -305,6 +474,12 @@ stat_t command_sync_speed(char *cmd) {
   // Queue
   command_push(COMMAND_sync_speed, &s);
 
+  // Sync speeds take effect part way through the last queued move
+  float early = 0;
+  if (s.dist < lead.move_length)
+    early = lead.move_time * (1 - s.dist / lead.move_length);
+  _lead_push(s.speed, early, false);
+
   return STAT_OK;
 }
 
@@ -313,7 +488,7 @@ unsigned command_sync_speed_size() {return sizeof(sync_speed_t);}
 
 
 void command_sync_speed_exec(void *data) {
-  _set_speed(((sync_speed_t *)data)->speed);
+  if (!_lead_pop()) _set_speed(((sync_speed_t *)data)->speed);
 }
 
 
@@ -326,10 +501,70 @@ stat_t command_speed(char *cmd) {
 
   // Queue
   command_push(COMMAND_speed, &speed);
+  _lead_push(speed, 0, false);
 
   return STAT_OK;
 }
 
 
 unsigned command_speed_size() {return sizeof(float);}
-void command_speed_exec(void *data) {_set_speed(*(float *)data);}
+
+
+void command_speed_exec(void *data) {
+  if (!_lead_pop()) _set_speed(*(float *)data);
+}
+
+
+static bool _at_speed() {
+  if (spindle.type == SPINDLE_TYPE_DISABLED) return true;
+
+  float target = fabs(_speed_to_power(spindle.speed));
+  float band = at_speed.tolerance * (target ? target : 1);
+
+  return fabs(fabs(_get_power()) - target) <= band;
+}
+
+
+static stat_t _at_speed_exec() {
+  if (state_get() == STATE_STOPPING || _at_speed()) exec_set_cb(0);
+
+  else if (at_speed.timed && rtc_expired(at_speed.timeout)) {
+    exec_set_cb(0);
+    estop_trigger(STAT_SPINDLE_TIMEOUT);
+  }
+
+  return STAT_NOP;
+}
+
+
+stat_t command_at_speed(char *cmd) {
+  at_speed_t w;
+
+  cmd++; // Skip command code
+
+  // Get tolerance and timeout
+  if (!decode_float(&cmd, &w.tolerance) || w.tolerance < 0)
+    return STAT_BAD_FLOAT;
+  if (!decode_float(&cmd, &w.timeout) || w.timeout < 0) return STAT_BAD_FLOAT;
+
+  // Queue
+  command_push(COMMAND_at_speed, &w);
+  spindle_queue_barrier();
+
+  return STAT_OK;
+}
+
+
+unsigned command_at_speed_size() {return sizeof(at_speed_t);}
+
+
+void command_at_speed_exec(void *data) {
+  spindle_barrier_done();
+  at_speed_t *w = (at_speed_t *)data;
+
+  at_speed.tolerance = w->tolerance;
+  at_speed.timed = w->timeout;
+  at_speed.timeout = rtc_get_time() + w->timeout * 1000;
+
+  exec_set_cb(_at_speed_exec); // Hold exec until the spindle is at speed
+}
@@ -74,3 +74,8 @@ void spindle_load_power_updates(power_update_t updates[], float minD,
 void spindle_update(const power_update_t &update);
 void spindle_update_speed();
 void spindle_idle();
+void spindle_queue_move(float time, float length);
+void spindle_queue_barrier();
+void spindle_barrier_done();
+void spindle_advance(float time);
+void spindle_reset_queue();
@@ -0,0 +1,136 @@
+/******************************************************************************\
+
+                  This file is part of the Buildbotics firmware.
+
+         Copyright (c) 2015 - 2021, Buildbotics LLC, All rights reserved.
+
+          This Source describes Open Hardware and is licensed under the
+                                  CERN-OHL-S v2.
+
+          You may redistribute and modify this Source and make products
+     using it under the terms of the CERN-OHL-S v2 (https:/cern.ch/cern-ohl).
+            This Source is distributed WITHOUT ANY EXPRESS OR IMPLIED
+     WARRANTY, INCLUDING OF MERCHANTABILITY, SATISFACTORY QUALITY AND FITNESS
+      FOR A PARTICULAR PURPOSE. Please see the CERN-OHL-S v2 for applicable
+                                   conditions.
+
+                 Source location: https://github.com/buildbotics
+
+       As per CERN-OHL-S v2 section 4, should You produce hardware based on
+     these sources, You must maintain the Source Location clearly visible on
+     the external case of the CNC Controller or other product you make using
+                                   this Source.
+
+                 For more information, email info@buildbotics.com
+
+\******************************************************************************/
+
+#include "spindle_index.h"
+#include "config.h"
+#include "pins.h"
+#include "rtc.h"
+
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+
+// Spindle rotation is measured from a once per revolution index pulse.
+// Pulses are timestamped in RTC counts and the angle between pulses is
+// interpolated from the last period.
+static struct {
+  bool enabled;
+  uint32_t count;  // Index pulses seen
+  uint32_t last;   // Time of the last pulse, RTC counts
+  uint32_t period; // Last revolution period, RTC counts, zero if stopped
+} idx;
+
+
+ISR(SPINDLE_INDEX_ISR_vect) {
+  uint32_t now = rtc_get_counts();
+  uint32_t delta = now - idx.last;
+
+  if (delta < SPINDLE_INDEX_MIN * RTC_FREQ) return; // Noise
+
+  idx.period = idx.count && delta < SPINDLE_INDEX_TIMEOUT * RTC_FREQ ?
+    delta : 0;
+  idx.last = now;
+  idx.count++;
+}
+
+
+bool spindle_index_enabled() {return idx.enabled;}
+
+
+uint32_t spindle_index_count() {
+  uint32_t count;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) count = idx.count;
+  return count;
+}
+
+
+/// Revolutions since index count @param since, predicted @param ahead mins
+/// in the future.  The fraction is held just short of the next pulse.
+float spindle_index_revs(uint32_t since, float ahead) {
+  uint32_t now, count, last, period;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    now = rtc_get_counts();
+    count = idx.count;
+    last = idx.last;
+    period = idx.period;
+  }
+
+  float revs = (int32_t)(count - since);
+  uint32_t delta = now - last;
+
+  if (period && delta < SPINDLE_INDEX_TIMEOUT * RTC_FREQ) {
+    float frac = (delta + ahead * 60 * RTC_FREQ) / period;
+    revs += frac < 0.999 ? frac : 0.999;
+  }
+
+  return revs;
+}
+
+
+float spindle_index_rpm() {
+  uint32_t now, last, period;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    now = rtc_get_counts();
+    last = idx.last;
+    period = idx.period;
+  }
+
+  if (!period || SPINDLE_INDEX_TIMEOUT * RTC_FREQ <= now - last) return 0;
+  return 60.0 * RTC_FREQ / period;
+}
+
+
+// Var callbacks
+bool get_index_enable() {return idx.enabled;}
+
+
+void set_index_enable(bool enable) {
+  if (idx.enabled == enable) return;
+
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    idx.enabled = enable;
+    idx.period = 0;
+  }
+
+  PORT_t *port = PIN_PORT(SPINDLE_INDEX_PIN);
+
+  if (enable) {
+    PINCTRL_PIN(SPINDLE_INDEX_PIN) = PORT_OPC_PULLUP_gc | PORT_ISC_FALLING_gc;
+    port->INT0MASK |= PIN_BM(SPINDLE_INDEX_PIN);
+    port->INTCTRL = (port->INTCTRL & ~PORT_INT0LVL_gm) | PORT_INT0LVL_MED_gc;
+
+  } else {
+    port->INT0MASK &= ~PIN_BM(SPINDLE_INDEX_PIN);
+    port->INTCTRL &= ~PORT_INT0LVL_gm;
+    PINCTRL_PIN(SPINDLE_INDEX_PIN) = PORT_OPC_PULLUP_gc;
+  }
+}
+
+
+float get_index_rpm() {return spindle_index_rpm();}
@@ -212,7 +212,10 @@ stat_t command_pause(char *cmd) {
   pause_t type = (pause_t)(cmd[1] - '0');
 
   if (type == PAUSE_USER) s.pause_requested = true;
-  else command_push(cmd[0], &type);
+  else {
+    command_push(cmd[0], &type);
+    spindle_queue_barrier();
+  }
 
   return STAT_OK;
 }
@@ -222,6 +225,8 @@ unsigned command_pause_size() {return sizeof(pause_t);}
 
 
 void command_pause_exec(void *data) {
+  spindle_barrier_done();
+
   switch (*(pause_t *)data) {
   case PAUSE_PROGRAM_OPTIONAL:
     _set_hold_reason(HOLD_REASON_OPTIONAL_PAUSE);
@@ -35,6 +35,7 @@
 #include "cpp_magic.h"
 #include "exec.h"
 #include "drv8711.h"
+#include "scope.h"
 
 #include <util/atomic.h>
 
@@ -46,6 +47,7 @@ typedef struct {
   // Runtime
   bool busy;
   bool requesting;
+  uint8_t tick;
   float dwell;
   uint8_t power_buf;
   uint8_t power_index;
@@ -59,6 +61,7 @@ typedef struct {
   power_update_t powers[2][POWER_MAX_UPDATES];
 
   uint32_t underrun;
+  uint16_t slack; // us left for the last prep
 } stepper_t;
 
 
@@ -97,6 +100,19 @@ void st_shutdown() {
 bool st_is_busy() {return st.busy;}
 
 
+/// Time in us between the last finished move prep and its load
+uint16_t st_get_slack() {return st.slack;}
+
+
+/// Step timer counts until the loader takes the prepped move
+static uint16_t _slack() {
+  uint8_t ticks = (4 - st.tick) & 3; // Whole ticks before the loading tick
+  uint16_t count = ticks * (STEP_TIMER_POLL + 1) +
+    STEP_TIMER_POLL - TIMER_STEP.CNT;
+  return count / (STEP_TIMER_FREQ / 1000000);
+}
+
+
 /// Interrupt handler for calling move exec function.
 /// ADC channel 0 triggered by load ISR as a "software" interrupt.
 ISR(STEP_LOW_LEVEL_ISR) {
@@ -110,6 +126,7 @@ ISR(STEP_LOW_LEVEL_ISR) {
         exec_set_velocity(0); // Velocity is zero if there are no moves
 
         spindle_idle();
+        scope_idle();
       }
       break;
 
@@ -120,6 +137,7 @@ ISR(STEP_LOW_LEVEL_ISR) {
         estop_trigger(STAT_EXPECTED_MOVE);  // No move was queued
       st.move_queued = false;
       st.move_ready = true;
+      st.slack = _slack();
       break;
 
     default: estop_trigger(status); break;
@@ -152,8 +170,6 @@ static void _update_power() {
 /// Step timer interrupt routine.
 /// Dwell or dequeue and load next move.
 ISR(STEP_TIMER_ISR) {
-  static uint8_t tick = 0;
-
   // Update spindle power on every tick
   _update_power();
 
@@ -164,13 +180,13 @@ ISR(STEP_TIMER_ISR) {
   }
   st.dwell = 0;
 
-  if (tick++ & 3) return; // Proceed every 4 ticks
+  if (st.tick++ & 3) return; // Proceed every 4 ticks
 
   // If the next move is not ready try to load it
   if (!st.move_ready) {
     _request_exec_move();
     _end_move();
-    tick = 0; // Try again in 1ms
+    st.tick = 0; // Try again in 1ms
     st.busy = false;
     return;
   }
@@ -36,6 +36,7 @@
 void stepper_init();
 void st_shutdown();
 bool st_is_busy();
+uint16_t st_get_slack();
 void st_set_power_scale(float scale);
 void st_prep_power(const power_update_t powers[]);
 void st_prep_line(const float target[]);
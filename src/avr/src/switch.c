@@ -27,6 +27,7 @@
 
 #include "switch.h"
 #include "config.h"
+#include "spindle_index.h"
 
 #include <stdbool.h>
 #include <stdio.h>
@@ -90,6 +91,15 @@ void switch_rtc_callback() {
     switch_t *s = &switches[i];
 
     if (s->type == SW_DISABLED) continue;
+
+    // Ignore the pin while it is used as the spindle index input
+    if (s->pin == SPINDLE_INDEX_PIN && spindle_index_enabled()) {
+      bool wasActive = switch_is_active((switch_id_t)i);
+      s->initialized = false;
+      if (wasActive && s->cb) s->cb((switch_id_t)i, false);
+      continue;
+    }
+
     if (s->lockout && --s->lockout) continue;
 
     // Debounce switch
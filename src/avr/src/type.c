@@ -27,6 +27,7 @@
 
 #include "type.h"
 #include "base64.h"
+#include "util.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -44,17 +45,55 @@
 #undef TYPEDEF
 
 
+// Numeric values are packed raw in little-endian byte order
+#define PACK_RAW(TYPE)                                                  \
+  uint8_t type_pack_##TYPE(TYPE x, uint8_t *buf, uint8_t len) {         \
+    if (len < sizeof(TYPE)) return 0;                                   \
+    memcpy(buf, &x, sizeof(TYPE));                                      \
+    return sizeof(TYPE);                                                \
+  }                                                                     \
+                                                                        \
+  uint8_t type_unpack_##TYPE(TYPE *x, const uint8_t *buf, uint8_t len) { \
+    if (len < sizeof(TYPE)) return 0;                                   \
+    memcpy(x, buf, sizeof(TYPE));                                       \
+    return sizeof(TYPE);                                                \
+  }
+
+
 // String
 bool type_eq_str(str a, str b) {return a == b;}
 void type_print_str(str s) {printf_P(PSTR("\"%s\""), s);}
 str type_parse_str(const char *s, stat_t *) {return s;}
 
+
+uint8_t type_pack_str(str s, uint8_t *buf, uint8_t len) {
+  unsigned size = strlen(s) + 1;
+  if (len < size) return 0;
+  memcpy(buf, s, size);
+  return size;
+}
+
+
+// Strings are not unpacked, there is nowhere to keep them
+uint8_t type_unpack_str(str *s, const uint8_t *buf, uint8_t len) {return 0;}
+
 // Program string
 bool type_eq_pstr(pstr a, pstr b) {return a == b;}
 void type_print_pstr(pstr s) {printf_P(PSTR("\"%" PRPSTR "\""), s);}
 const char *type_parse_pstr(const char *value, stat_t *) {return value;}
 
 
+uint8_t type_pack_pstr(pstr s, uint8_t *buf, uint8_t len) {
+  unsigned size = strlen_P(s) + 1;
+  if (len < size) return 0;
+  memcpy_P(buf, s, size);
+  return size;
+}
+
+
+uint8_t type_unpack_pstr(pstr *s, const uint8_t *buf, uint8_t len) {return 0;}
+
+
 // Float
 bool type_eq_f32(float a, float b) {return a == b || (isnan(a) && isnan(b));}
 
@@ -64,26 +103,16 @@ void type_print_f32(float x) {
   else if (isinf(x)) printf_P(PSTR("\"%cinf\""), x < 0 ? '-' : '+');
 
   else {
-    char buf[20];
-
-    int len = sprintf_P(buf, PSTR("%.3f"), x);
-
-    // Remove trailing zeros
-    for (int i = len; 0 < i; i--) {
-      if (buf[i - 1] == '.') buf[i - 1] = 0;
-      else if (buf[i - 1] == '0') {
-        buf[i - 1] = 0;
-        continue;
-      }
-
-      break;
-    }
-
-    printf(buf);
+    char buf[FORMAT_FLOAT_MAX];
+    format_float(buf, x);
+    fputs(buf, stdout);
   }
 }
 
 
+PACK_RAW(f32)
+
+
 float type_parse_f32(const char *value, stat_t *status) {
   while (*value && isspace(*value)) value++;
 
@@ -117,6 +146,7 @@ float type_parse_f32(const char *value, stat_t *status) {
 // bool
 bool type_eq_b8(bool a, bool b) {return a == b;}
 void type_print_b8(bool x) {printf_P(x ? PSTR("true") : PSTR("false"));}
+PACK_RAW(b8)
 
 
 bool type_parse_b8(const char *value, stat_t *status) {
@@ -127,6 +157,7 @@ bool type_parse_b8(const char *value, stat_t *status) {
 // s8
 bool type_eq_s8(s8 a, s8 b) {return a == b;}
 void type_print_s8(s8 x) {printf_P(PSTR("%" PRIi8), x);}
+PACK_RAW(s8)
 
 
 s8 type_parse_s8(const char *value, stat_t *status) {
@@ -140,6 +171,7 @@ s8 type_parse_s8(const char *value, stat_t *status) {
 // u8
 bool type_eq_u8(u8 a, u8 b) {return a == b;}
 void type_print_u8(u8 x) {printf_P(PSTR("%" PRIu8), x);}
+PACK_RAW(u8)
 
 
 u8 type_parse_u8(const char *value, stat_t *status) {
@@ -153,6 +185,7 @@ u8 type_parse_u8(const char *value, stat_t *status) {
 // u16
 bool type_eq_u16(u16 a, u16 b) {return a == b;}
 void type_print_u16(u16 x) {printf_P(PSTR("%" PRIu16), x);}
+PACK_RAW(u16)
 
 
 u16 type_parse_u16(const char *value, stat_t *status) {
@@ -166,6 +199,7 @@ u16 type_parse_u16(const char *value, stat_t *status) {
 // s32
 bool type_eq_s32(s32 a, s32 b) {return a == b;}
 void type_print_s32(s32 x) {printf_P(PSTR("%" PRIi32), x);}
+PACK_RAW(s32)
 
 
 s32 type_parse_s32(const char *value, stat_t *status) {
@@ -179,6 +213,7 @@ s32 type_parse_s32(const char *value, stat_t *status) {
 // u32
 bool type_eq_u32(u32 a, u32 b) {return a == b;}
 void type_print_u32(u32 x) {printf_P(PSTR("%" PRIu32), x);}
+PACK_RAW(u32)
 
 
 u32 type_parse_u32(const char *value, stat_t *status) {
@@ -214,3 +249,28 @@ void type_print(type_t type, type_u value) {
 #undef TYPEDEF
   }
 }
+
+
+uint8_t type_pack(type_t type, type_u value, uint8_t *buf, uint8_t len) {
+  switch (type) {
+#define TYPEDEF(TYPE, ...)                                              \
+    case TYPE_##TYPE: return type_pack_##TYPE(value._##TYPE, buf, len);
+#include "type.def"
+#undef TYPEDEF
+  }
+
+  return 0;
+}
+
+
+uint8_t type_unpack(type_t type, type_u *value, const uint8_t *buf,
+                    uint8_t len) {
+  switch (type) {
+#define TYPEDEF(TYPE, ...)                                              \
+    case TYPE_##TYPE: return type_unpack_##TYPE(&value->_##TYPE, buf, len);
+#include "type.def"
+#undef TYPEDEF
+  }
+
+  return 0;
+}
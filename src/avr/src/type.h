@@ -54,14 +54,19 @@ typedef union {
 
 
 // Define functions
-#define TYPEDEF(TYPE, DEF)                                  \
-  pstr type_get_##TYPE##_name_pgm();                        \
-  bool type_eq_##TYPE(TYPE a, TYPE b);                      \
-  TYPE type_parse_##TYPE(const char *s, stat_t *status);    \
-  void type_print_##TYPE(TYPE x);
+#define TYPEDEF(TYPE, DEF)                                              \
+  pstr type_get_##TYPE##_name_pgm();                                    \
+  bool type_eq_##TYPE(TYPE a, TYPE b);                                  \
+  TYPE type_parse_##TYPE(const char *s, stat_t *status);                \
+  void type_print_##TYPE(TYPE x);                                       \
+  uint8_t type_pack_##TYPE(TYPE x, uint8_t *buf, uint8_t len);          \
+  uint8_t type_unpack_##TYPE(TYPE *x, const uint8_t *buf, uint8_t len);
 #include "type.def"
 #undef TYPEDEF
 
 
 type_u type_parse(type_t type, const char *s, stat_t *status);
 void type_print(type_t type, type_u value);
+uint8_t type_pack(type_t type, type_u value, uint8_t *buf, uint8_t len);
+uint8_t type_unpack(type_t type, type_u *value, const uint8_t *buf,
+                    uint8_t len);
@@ -28,13 +28,17 @@
 #include "usart.h"
 #include "cpp_magic.h"
 #include "config.h"
+#include "rtc.h"
+#include "status.h"
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <util/atomic.h>
 
 #include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdlib.h>
 
 
 // Ring buffers
@@ -51,6 +55,22 @@
 #include "ringbuf.def"
 
 static bool _flush = false;
+static uint16_t _rx_count = 0;
+
+
+static struct {
+  baud_t baud;          // Confirmed baud rate
+  baud_t next;          // Rate to switch to once TX drains
+  bool pending;         // Switch requested
+  bool trial;           // Running at an unconfirmed rate
+  bool probed;          // Trial rate passed the probe
+  uint32_t drained;     // Last time TX was busy
+  uint32_t timeout;     // Revert trial rate after this time
+  uint32_t window;      // Start of error rate window
+  uint16_t window_errors;
+  uint16_t trial_errors;
+  volatile uint16_t errors; // RX framing and overrun errors
+} _baud = {SERIAL_BAUD, SERIAL_BAUD};
 
 
 static void _set_dre_interrupt(bool enable) {
@@ -83,6 +103,8 @@ ISR(SERIAL_DRE_vect) {
 
 // Data received interrupt vector
 ISR(SERIAL_RXC_vect) {
+  if (SERIAL_PORT.STATUS & (USART_FERR_bm | USART_BUFOVF_bm)) _baud.errors++;
+
   if (rx_buf_full()) _set_rxc_interrupt(false); // Disable interrupt
   else rx_buf_push(SERIAL_PORT.DATA);
 
@@ -227,6 +249,7 @@ void usart_puts(const char *s) {while (*s) usart_putc(*s++);}
 int8_t usart_getc() {
   while (rx_buf_empty()) continue;
   uint8_t data = rx_buf_next();
+  _rx_count++;
   _set_rxc_interrupt(true); // Enable interrupt
   return data;
 }
@@ -277,8 +300,141 @@ void usart_flush() {
 }
 
 
+uint32_t usart_get_bps(baud_t baud) {
+  switch (baud) {
+  case USART_BAUD_9600:    return 9600;
+  case USART_BAUD_19200:   return 19200;
+  case USART_BAUD_38400:   return 38400;
+  case USART_BAUD_57600:   return 57600;
+  case USART_BAUD_115200:  return 115200;
+  case USART_BAUD_230400:  return 230400;
+  case USART_BAUD_460800:  return 460800;
+  case USART_BAUD_921600:  return 921600;
+  case USART_BAUD_500000:  return 500000;
+  case USART_BAUD_1000000: return 1000000;
+  }
+
+  return 0;
+}
+
+
+static bool _baud_from_bps(uint32_t bps, baud_t *baud) {
+  switch (bps) {
+  case 9600:    *baud = USART_BAUD_9600;    return true;
+  case 19200:   *baud = USART_BAUD_19200;   return true;
+  case 38400:   *baud = USART_BAUD_38400;   return true;
+  case 57600:   *baud = USART_BAUD_57600;   return true;
+  case 115200:  *baud = USART_BAUD_115200;  return true;
+  case 230400:  *baud = USART_BAUD_230400;  return true;
+  case 460800:  *baud = USART_BAUD_460800;  return true;
+  case 921600:  *baud = USART_BAUD_921600;  return true;
+  case 500000:  *baud = USART_BAUD_500000;  return true;
+  case 1000000: *baud = USART_BAUD_1000000; return true;
+  }
+
+  return false;
+}
+
+
+static void _baud_switch(baud_t baud) {
+  _baud.next = baud;
+  _baud.pending = true;
+  _baud.drained = rtc_get_time();
+}
+
+
+static uint16_t _baud_errors() {
+  uint16_t errors;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) errors = _baud.errors;
+  return errors;
+}
+
+
+void usart_callback() {
+  uint16_t errors = _baud_errors();
+
+  if (_baud.pending) {
+    // Wait for the last character to leave the shift register
+    if (!usart_tx_empty() || !(SERIAL_PORT.STATUS & USART_DREIF_bm))
+      _baud.drained = rtc_get_time();
+
+    if (!rtc_expired(_baud.drained + 2)) return;
+
+    usart_set_baud(&SERIAL_PORT, _baud.next);
+    _baud.pending = false;
+    _baud.trial = _baud.next != _baud.baud;
+    _baud.probed = false;
+    _baud.timeout = rtc_get_time() + SERIAL_BAUD_TIMEOUT;
+    _baud.trial_errors = errors;
+  }
+
+  // Revert unconfirmed rate
+  if (_baud.trial && rtc_expired(_baud.timeout)) {
+    _baud.trial = false;
+    _baud_switch(_baud.baud);
+  }
+
+  // Fall back to the default rate if the link is failing
+  if (rtc_expired(_baud.window)) {
+    _baud.window = rtc_get_time() + 1000;
+    _baud.window_errors = errors;
+
+  } else if (_baud.baud != SERIAL_BAUD &&
+             SERIAL_BAUD_MAX_ERRORS <= errors - _baud.window_errors) {
+    _baud.baud = SERIAL_BAUD;
+    _baud.trial = false;
+    _baud_switch(SERIAL_BAUD);
+  }
+}
+
+
 void usart_rx_flush() {rx_buf_init();}
 int16_t usart_rx_space() {return rx_buf_space();}
 int16_t usart_rx_fill() {return rx_buf_fill();}
+uint16_t usart_rx_count() {return _rx_count;}
 int16_t usart_tx_space() {return tx_buf_space();}
 int16_t usart_tx_fill() {return tx_buf_fill();}
+
+
+// Command callbacks
+stat_t command_baud(char *cmd) {
+  static const char fmt[] PROGMEM = "{\"baud\":\"%" PRPSTR "\"}\n";
+
+  switch (cmd[1]) {
+  case '!': // Probe trial rate
+    if (!_baud.trial || strcmp_P(cmd + 2, PSTR(USART_BAUD_PROBE)) ||
+        _baud_errors() != _baud.trial_errors) {
+      printf_P(fmt, PSTR("fail"));
+      _baud.trial = false;
+      _baud_switch(_baud.baud);
+
+    } else {
+      _baud.probed = true;
+      printf_P(fmt, PSTR("ok"));
+    }
+    break;
+
+  case '+': // Confirm trial rate
+    if (!_baud.trial || !_baud.probed) return STAT_INVALID_COMMAND;
+    _baud.baud = _baud.next;
+    _baud.trial = false;
+    printf_P(fmt, PSTR("commit"));
+    break;
+
+  default: { // Switch to trial rate
+    char *end;
+    baud_t baud;
+    uint32_t bps = strtoul(cmd + 1, &end, 10);
+
+    if (end == cmd + 1 || *end || !_baud_from_bps(bps, &baud))
+      return STAT_INVALID_ARGUMENTS;
+    if (_baud.pending || _baud.trial) return STAT_INVALID_COMMAND;
+
+    printf_P(fmt, PSTR("switch"));
+    _baud_switch(baud);
+    break;
+  }
+  }
+
+  return STAT_OK;
+}
@@ -37,6 +37,9 @@
 #define USART_TX_RING_BUF_SIZE 1024
 #define USART_RX_RING_BUF_SIZE 1024
 
+// Sent by the host to verify a new baud rate, must match Cmd.py
+#define USART_BAUD_PROBE "UUUU****3333ffff~~~~@@@@"
+
 
 typedef enum {
   USART_BAUD_9600,
@@ -80,6 +83,7 @@ void usart_set_stop(USART_t *port, stop_t stop);
 void usart_set_bits(USART_t *port, bits_t bits);
 void usart_init_port(USART_t *port, baud_t baud, parity_t parity, bits_t bits,
                      stop_t stop);
+uint32_t usart_get_bps(baud_t baud);
 
 void usart_init();
 void usart_putc(char c);
@@ -87,10 +91,12 @@ void usart_puts(const char *s);
 int8_t usart_getc();
 char *usart_readline();
 void usart_flush();
+void usart_callback();
 
 void usart_rx_flush();
 int16_t usart_rx_fill();
 int16_t usart_rx_space();
+uint16_t usart_rx_count();
 inline bool usart_rx_empty() {return !usart_rx_fill();}
 inline bool usart_rx_full() {return !usart_rx_space();}
 
@@ -55,6 +55,19 @@ float invsqrt(float x) {
 }
 
 
+/// Linearly interpolate a table of @param size points evenly spaced over
+/// [0, 1].  @param x is clamped to that range.
+float lut_interp(const float lut[], uint8_t size, float x) {
+  if (x <= 0) return lut[0];
+  if (1 <= x) return lut[size - 1];
+
+  x *= size - 1;
+  uint8_t i = x;
+
+  return lut[i] + (lut[i + 1] - lut[i]) * (x - i);
+}
+
+
 int8_t decode_hex_nibble(char c) {
   if ('0' <= c && c <= '9') return c - '0';
   if ('a' <= c && c <= 'f') return c - 'a' + 10;
@@ -93,3 +106,186 @@ void format_hex_buf(char *buf, const uint8_t *data, unsigned len) {
 
   buf[i * 2] = 0;
 }
+
+
+// Divide little-endian 16-bit limbs by 10 in place, returns the remainder
+static uint8_t _divmod10(uint16_t *limbs, uint8_t len) {
+  uint32_t r = 0;
+
+  for (int i = len - 1; 0 <= i; i--) {
+    r = r << 16 | limbs[i];
+    limbs[i] = r / 10;
+    r %= 10;
+  }
+
+  return r;
+}
+
+
+/// Formats a finite float exactly as printf("%.3f") would, with trailing
+/// zeros removed, using only integer math.  Assumes @param buf holds at
+/// least FORMAT_FLOAT_MAX bytes.  Returns the formatted length.
+uint8_t format_float(char *buf, float x) {
+  union {float f; uint32_t u;} bits;
+  bits.f = x;
+
+  char *s = buf;
+  if (bits.u >> 31) *s++ = '-';
+
+  // x = m * 2^e
+  int16_t e = (bits.u >> 23) & 0xff;
+  uint32_t m = bits.u & 0x7fffff;
+  if (e) m |= 0x800000;
+  else e = 1; // Subnormal
+  e -= 150;
+
+  char digits[40];
+  uint8_t n = 0;
+  uint16_t frac = 0; // Thousandths
+
+  if (8 < e) {
+    // Integer part does not fit in 32-bits
+    uint16_t limbs[9] = {0};
+    uint8_t i = e >> 4;
+    uint8_t shift = e & 15;
+    uint32_t low = m << shift;
+    limbs[i] = low;
+    limbs[i + 1] = low >> 16;
+    limbs[i + 2] = shift ? m >> (32 - shift) : 0;
+
+    uint8_t len = 9;
+    while (!limbs[len - 1]) len--;
+
+    do {
+      digits[n++] = '0' + _divmod10(limbs, len);
+      while (len && !limbs[len - 1]) len--;
+    } while (len);
+
+  } else {
+    uint32_t i;
+
+    if (0 <= e) i = m << e;
+    else {
+      uint8_t k = -e;
+      i = k < 32 ? m >> k : 0;
+      uint32_t f = m - (i << (k < 32 ? k : 0));
+
+      // f / 2^k * 1000 = f * 125 / 2^(k - 3), rounded half to even
+      uint32_t scaled = f * 125;
+
+      if (k <= 3) frac = scaled << (3 - k);
+      else if (k - 3 < 32) {
+        uint8_t shift = k - 3;
+        uint32_t r = scaled & ((1UL << shift) - 1);
+        uint32_t half = 1UL << (shift - 1);
+        frac = scaled >> shift;
+        if (half < r || (r == half && (frac & 1))) frac++;
+      }
+
+      if (frac == 1000) {i++; frac = 0;}
+    }
+
+    do {
+      digits[n++] = '0' + i % 10;
+      i /= 10;
+    } while (i);
+  }
+
+  while (n) *s++ = digits[--n];
+
+  if (frac) {
+    *s++ = '.';
+    *s++ = '0' + frac / 100;
+    if (frac % 100) *s++ = '0' + frac / 10 % 10;
+    if (frac % 10) *s++ = '0' + frac % 10;
+  }
+
+  *s = 0;
+
+  return s - buf;
+}
+
+
+#ifndef __AVR__
+#include <stdlib.h>
+#include <time.h>
+
+
+static double _bench_time() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+// The printf based formatting format_float() replaces
+static uint8_t _format_float_printf(char *buf, float x) {
+  int len = sprintf(buf, "%.3f", x);
+
+  // Remove trailing zeros
+  for (int i = len; 0 < i; i--) {
+    if (buf[i - 1] == '.') buf[i - 1] = 0;
+    else if (buf[i - 1] == '0') {
+      buf[i - 1] = 0;
+      continue;
+    }
+
+    break;
+  }
+
+  return strlen(buf);
+}
+
+
+static float _test_float(unsigned i) {
+  // Edge cases, values near rounding ties then random bit patterns
+  static const float edges[] = {
+    0, -0.0, 0.0005, -0.0005, 0.0015, 0.9995, 1.0005, 2.5e-4, 1e-45,
+    4294967.5, 4294967296.0, 16777215, 16777216, 3.4028235e38, -3.4028235e38,
+  };
+  const unsigned count = sizeof(edges) / sizeof(edges[0]);
+
+  if (i < count) return edges[i];
+  if (i & 1) return (float)(rand() % 2000001 - 1000000) / 2000;
+
+  union {float f; uint32_t u;} bits;
+  do bits.u = (uint32_t)rand() << 16 ^ rand();
+  while (!isfinite(bits.f));
+
+  return bits.f;
+}
+
+
+void format_float_test() {
+  const unsigned count = 1000000;
+  float *values = (float *)malloc(count * sizeof(float));
+  char a[FORMAT_FLOAT_MAX], b[FORMAT_FLOAT_MAX];
+  unsigned errors = 0;
+
+  srand(1);
+  for (unsigned i = 0; i < count; i++) values[i] = _test_float(i);
+
+  // Check exactness against printf
+  for (unsigned i = 0; i < count; i++) {
+    format_float(a, values[i]);
+    _format_float_printf(b, values[i]);
+
+    if (strcmp(a, b) && errors++ < 10)
+      printf("Float format mismatch for %a: '%s' != '%s'\n", values[i], a, b);
+  }
+
+  // Compare speed
+  double start = _bench_time();
+  for (unsigned i = 0; i < count; i++) _format_float_printf(b, values[i]);
+  double printfTime = _bench_time() - start;
+
+  start = _bench_time();
+  for (unsigned i = 0; i < count; i++) format_float(a, values[i]);
+  double fastTime = _bench_time() - start;
+
+  printf("Float format: %u values, %u mismatches, %.1fx faster than printf\n",
+         count, errors, printfTime / fastTime);
+
+  free(values);
+}
+#endif // __AVR__
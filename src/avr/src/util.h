@@ -52,6 +52,7 @@ inline static float max4(float a, float b, float c, float d)
 {return max(max(a, b), max(c, d));}
 
 float invsqrt(float number);
+float lut_interp(const float lut[], uint8_t size, float x);
 
 #ifndef __AVR__
 inline static float square(float x) {return x * x;}
@@ -70,6 +71,13 @@ bool decode_float(char **s, float *f);
 stat_t decode_axes(char **cmd, float axes[AXES]);
 void format_hex_buf(char *buf, const uint8_t *data, unsigned len);
 
+#define FORMAT_FLOAT_MAX 48 // sign, 39 digits, point, 3 decimals and nul
+uint8_t format_float(char *buf, float x);
+
+#ifndef __AVR__
+void format_float_test();
+#endif
+
 // Constants
 #define MM_PER_INCH 25.4
 #define INCHES_PER_MM (1 / 25.4)
@@ -35,9 +35,17 @@
 #include "cpp_magic.h"
 #include "report.h"
 #include "command.h"
+#include "base64.h"
 
+#include <util/crc16.h>
+#include <avr/eeprom.h>
+
+#include <stddef.h>
 #include <string.h>
+#include <ctype.h>
+#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 // Format strings
 static const char code_fmt[] PROGMEM = "\"%s\":";
@@ -99,7 +107,7 @@ typedef struct {
 
 
 // Var names
-#define VAR(NAME, CODE, TYPE, INDEX, SET, REPORT)           \
+#define VAR(NAME, CODE, TYPE, INDEX, SET, REPORT, ...)      \
   static const char NAME##_name[] PROGMEM = #NAME;
 
 #include "vars.def"
@@ -114,32 +122,238 @@ typedef struct {
 #undef VAR
 
 
-// Report
-static uint8_t _report_var[(var_code_count >> 3) + 1] = {0,};
+// Bit positions of each var in _configured, one per index
+typedef struct {
+#define VAR(NAME, CODE, TYPE, INDEX, ...)       \
+  uint8_t NAME##_cfg IF(INDEX)([INDEX]);
+
+#include "vars.def"
+#undef VAR
+} var_bits_t;
+
 
+static const uint16_t _var_bit[] PROGMEM = {
+#define VAR(NAME, ...) offsetof(var_bits_t, NAME##_cfg),
 
-static bool _get_report_var(int index) {
-  return _report_var[index >> 3] & (1 << (index & 7));
+#include "vars.def"
+#undef VAR
+};
+
+
+// Vars set by config blobs
+static uint8_t _configured[(sizeof(var_bits_t) + 7) / 8];
+
+
+static uint16_t _configured_bit(uint8_t code, uint8_t index) {
+  return pgm_read_word(&_var_bit[code]) + index;
 }
 
 
-static void _set_report_var(int index, bool enable) {
-  if (enable) _report_var[index >> 3] |= 1 << (index & 7);
-  else _report_var[index >> 3] &= ~(1 << (index & 7));
+static void _set_configured(uint8_t code, uint8_t index) {
+  uint16_t bit = _configured_bit(code, index);
+  _configured[bit >> 3] |= 1 << (bit & 7);
 }
 
 
-static int _find_code(const char *code) {
-#define VAR(NAME, CODE, TYPE, INDEX, ...)                               \
-  if (!strcmp(code, #CODE)) return var_code_##CODE;                     \
+static bool _is_configured(uint8_t code, uint8_t index) {
+  uint16_t bit = _configured_bit(code, index);
+  return _configured[bit >> 3] & (1 << (bit & 7));
+}
+
+
+// Report classes
+#define REPORT_CLASS_0 REPORT_OFF
+#define REPORT_CLASS_1 REPORT_NORMAL
+#define REPORT_CLASS_F REPORT_FAST
+#define REPORT_CLASS_S REPORT_SLOW
+#define REPORT_CLASS_C REPORT_CHANGE
+
+static const uint8_t _report_default[] PROGMEM = {
+#define VAR(NAME, CODE, TYPE, INDEX, SET, REPORT, ...) REPORT_CLASS_##REPORT,
+#include "vars.def"
+#undef VAR
+};
+
+static uint8_t _report_class[var_code_count];
+
+
+// Report deadbands, float vars only
+typedef struct {
+  float abs;
+  float rel;
+} deadband_t;
+
+#define _IS_F32_f32 PROBE()
+#define IS_F32(TYPE) IS_PROBE(CAT(_IS_F32_, TYPE))
+
+#define VAR(NAME, CODE, TYPE, INDEX, SET, REPORT, ...)                  \
+  IF(IS_F32(TYPE))(static deadband_t NAME##_deadband = {__VA_ARGS__};)
+
+#include "vars.def"
+#undef VAR
+
+static deadband_t *const _deadbands[] PROGMEM = {
+#define VAR(NAME, CODE, TYPE, ...) IF_ELSE(IS_F32(TYPE))(&NAME##_deadband, 0),
+#include "vars.def"
+#undef VAR
+};
+
+
+// Changes within the deadband do not count, a change to zero always does
+static bool _deadband_eq(float value, float last, const deadband_t *db) {
+  if (type_eq_f32(value, last)) return true;
+  if (!value || isnan(value) || isnan(last)) return false;
+
+  float band = db->rel * fabs(last);
+  if (band < db->abs) band = db->abs;
+
+  return fabs(value - last) <= band;
+}
+
+
+static void _set_report_class(int code, int8_t rc) {
+  if (rc < 0) rc = pgm_read_byte(&_report_default[code]);
+  _report_class[code] = rc;
+}
+
+
+// Binary reports
+static struct {
+  bool enabled;
+  uint8_t length;
+  uint8_t data[REPORT_FRAME_SIZE];
+} _frame = {0,};
+
+
+// Frame: [start][length][payload][crc16], CRC covers length and payload
+static void _frame_flush() {
+  if (!_frame.length) return;
+
+  uint16_t crc = _crc16_update(0xffff, _frame.length);
+  putchar(REPORT_FRAME_START);
+  putchar(_frame.length);
+
+  for (uint8_t i = 0; i < _frame.length; i++) {
+    putchar(_frame.data[i]);
+    crc = _crc16_update(crc, _frame.data[i]);
+  }
+
+  putchar(crc);
+  putchar(crc >> 8);
+
+  _frame.length = 0;
+}
+
+
+// Entry: [var code index][label index if indexed][raw value]
+static bool _frame_add(uint8_t code, int8_t index, type_t type,
+                       type_u value) {
+  uint8_t *p = _frame.data + _frame.length;
+  uint8_t space = REPORT_FRAME_SIZE - _frame.length;
+
+  if (space < 2) return false;
+  *p++ = code;
+  space--;
+
+  if (index != -1) {
+    *p++ = index;
+    space--;
+  }
+
+  uint8_t len = type_pack(type, value, p, space);
+  if (!len) return false;
+
+  _frame.length = p + len - _frame.data;
+
+  return true;
+}
+
+
+static void _report_binary(uint8_t code, int8_t index, type_t type,
+                           type_u value) {
+  if (_frame_add(code, index, type, value)) return;
+  _frame_flush();
+  _frame_add(code, index, type, value);
+}
+
+
+// Var definitions, indexed by var code
+typedef struct {
+  char code[4];
+  uint8_t type;
+  const char *labels; // Index labels, null if not indexed
+  void *get;
+  void *set;
+} var_def_t;
+
+
+static const var_def_t _var_defs[] PROGMEM = {
+#define VAR(NAME, CODE, TYPE, INDEX, SET, ...)                          \
+  {#CODE, TYPE_##TYPE, IF_ELSE(INDEX)(INDEX##_LABEL, 0),                \
+   (void *)get_##NAME, IF_ELSE(SET)((void *)set_##NAME, 0)},
 
 #include "vars.def"
 #undef VAR
+};
+
+
+// Open addressed hash of var codes, entries are var code + 1.  The table
+// size matches the range of the 8-bit hash and must stay larger than the
+// number of vars.
+static uint8_t _var_hash[256];
+typedef char _var_hash_check[var_code_count < 255 ? 1 : -1];
+static uint16_t _var_layout = 0xffff; // CRC of var codes, types & indices
+
+
+static uint8_t _hash(const char *code) {
+  uint8_t h = 0;
+  while (*code) h = h * 31 + *code++;
+  return h;
+}
+
+
+static void _hash_init() {
+  for (uint8_t i = 0; i < var_code_count; i++) {
+    char code[4];
+    strcpy_P(code, _var_defs[i].code);
+
+    uint8_t h = _hash(code);
+    while (_var_hash[h]) h++;
+    _var_hash[h] = i + 1;
+
+    var_def_t def;
+    memcpy_P(&def, &_var_defs[i], sizeof(def));
+    uint8_t count = def.labels ? strlen(def.labels) : 0;
+    for (const char *c = code; *c; c++)
+      _var_layout = _crc16_update(_var_layout, *c);
+    _var_layout = _crc16_update(_var_layout, def.type);
+    _var_layout = _crc16_update(_var_layout, count);
+  }
+}
+
+
+static int _find_code(const char *code) {
+  for (uint8_t h = _hash(code); _var_hash[h]; h++) {
+    uint8_t i = _var_hash[h] - 1;
+    if (!strcmp_P(code, _var_defs[i].code)) return i;
+  }
+
   return -1;
 }
 
 
+static const char *_get_labels(int code) {
+  return (const char *)pgm_read_ptr(&_var_defs[code].labels);
+}
+
+
+static void _snapshot_restore();
+
+
 void vars_init() {
+  _hash_init();
+  _snapshot_restore();
+
   // Initialize var state
 #define VAR(NAME, CODE, TYPE, INDEX, ...)                       \
   IF(INDEX)(for (int i = 0; i < INDEX; i++))                    \
@@ -148,37 +362,45 @@ void vars_init() {
 #include "vars.def"
 #undef VAR
 
-// Report
-#define VAR(NAME, CODE, TYPE, INDEX, SET, REPORT, ...)  \
-  _set_report_var(var_code_##CODE, REPORT);
-
-#include "vars.def"
-#undef VAR
+  vars_report_all(-1);
 }
 
 
-void vars_report(bool full) {
+void vars_report(uint8_t classes, bool full) {
   bool reported = false;
 
 #define VAR(NAME, CODE, TYPE, INDEX, ...)                               \
-  if (_get_report_var(var_code_##CODE)) {                               \
+  if ((1 << _report_class[var_code_##CODE]) & classes &                 \
+      ~(1 << REPORT_OFF)) {                                             \
     IF(INDEX)(for (int i = 0; i < (INDEX ? INDEX : 1); i++)) {          \
       TYPE value = get_##NAME(IF(INDEX)(i));                            \
       TYPE last = (NAME##_state)IF(INDEX)([i]);                         \
                                                                         \
-      if (full || (!type_eq_##TYPE(value, last))) {                     \
+      bool eq = IF_ELSE(IS_F32(TYPE))                                   \
+        (_deadband_eq(value, last, &NAME##_deadband),                   \
+         type_eq_##TYPE(value, last));                                  \
+                                                                        \
+      if (full || !eq) {                                                \
         (NAME##_state)IF(INDEX)([i]) = value;                           \
                                                                         \
-        if (!reported) {                                                \
-          reported = true;                                              \
-          putchar('{');                                                 \
-        } else putchar(',');                                            \
+        if (_frame.enabled) {                                           \
+          type_u u;                                                     \
+          u._##TYPE = value;                                            \
+          _report_binary(var_code_##CODE, IF_ELSE(INDEX)(i, -1),        \
+                         TYPE_##TYPE, u);                               \
+                                                                        \
+        } else {                                                        \
+          if (!reported) {                                              \
+            reported = true;                                            \
+            putchar('{');                                               \
+          } else putchar(',');                                          \
                                                                         \
-        printf_P                                                        \
-          (IF_ELSE(INDEX)(indexed_code_fmt, code_fmt),                  \
-           IF(INDEX)(INDEX##_LABEL[i],) #CODE);                         \
+          printf_P                                                      \
+            (IF_ELSE(INDEX)(indexed_code_fmt, code_fmt),                \
+             IF(INDEX)(INDEX##_LABEL[i],) #CODE);                       \
                                                                         \
-        type_print_##TYPE(value);                                       \
+          type_print_##TYPE(value);                                     \
+        }                                                               \
       }                                                                 \
     }                                                                   \
   }
@@ -187,20 +409,19 @@ void vars_report(bool full) {
 #undef VAR
 
   if (reported) printf("}\n");
+  _frame_flush();
 }
 
-void vars_report_all(bool enable) {
-#define VAR(NAME, CODE, TYPE, INDEX, SET, REPORT, ...)                  \
-  _set_report_var(var_code_##CODE, enable);
-
-#include "vars.def"
-#undef VAR
+// A negative report class restores the default from vars.def
+void vars_report_all(int8_t rc) {
+  for (int code = 0; code < var_code_count; code++)
+    _set_report_class(code, rc);
 }
 
 
-void vars_report_var(const char *code, bool enable) {
+void vars_report_var(const char *code, int8_t rc) {
   int index = _find_code(code);
-  if (index != -1) _set_report_var(index, enable);
+  if (index != -1) _set_report_class(index, rc);
 }
 
 
@@ -239,6 +460,43 @@ static bool _find_var(const char *_name, var_info_t *info) {
   char *name = _resolve_name(_name);
   if (!name) return false;
 
+  // Either a plain code or an index label followed by an indexed code
+  int code = _find_code(name);
+  if (code != -1 && _get_labels(code)) code = -1;
+
+  int i = -1;
+  int indexed = _find_code(name + 1);
+  if (indexed != -1) {
+    const char *labels = _get_labels(indexed);
+    if (labels) i = _index(name[0], labels);
+  }
+
+  // The first match in vars.def wins
+  if (i != -1 && (code == -1 || indexed < code)) code = indexed;
+  else i = -1;
+
+  if (code == -1) return false;
+
+  var_def_t def;
+  memcpy_P(&def, &_var_defs[code], sizeof(def));
+
+  memset(info, 0, sizeof(var_info_t));
+  strcpy(info->name, name);
+  info->type = (type_t)def.type;
+  info->index = i;
+  info->get.ptr = def.get;
+  info->set.ptr = def.set;
+
+  return true;
+}
+
+
+#ifndef __AVR__
+// Linear scan lookup, kept to benchmark against the hash lookup
+static bool _find_var_scan(const char *_name, var_info_t *info) {
+  char *name = _resolve_name(_name);
+  if (!name) return false;
+
   int i = -1;
   memset(info, 0, sizeof(var_info_t));
   strcpy(info->name, name);
@@ -266,6 +524,62 @@ static bool _find_var(const char *_name, var_info_t *info) {
 }
 
 
+#include <time.h>
+
+
+static double _bench_time() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static double _bench(bool (*find)(const char *, var_info_t *),
+                     char names[][5], unsigned count) {
+  const unsigned rounds = 20000;
+  var_info_t info;
+
+  double start = _bench_time();
+  for (unsigned r = 0; r < rounds; r++)
+    for (unsigned i = 0; i < count; i++)
+      find(names[i], &info);
+
+  return rounds * count / (_bench_time() - start);
+}
+
+
+void vars_benchmark() {
+  // Every var, indexed vars with their last label
+  char names[var_code_count][5];
+
+  for (unsigned i = 0; i < var_code_count; i++) {
+    char *name = names[i];
+    const char *labels = _get_labels(i);
+    if (labels) *name++ = labels[strlen(labels) - 1];
+    strcpy_P(name, _var_defs[i].code);
+  }
+
+  // Check both lookups agree
+  for (unsigned i = 0; i < var_code_count; i++) {
+    var_info_t a, b;
+
+    if (!_find_var(names[i], &a) || !_find_var_scan(names[i], &b) ||
+        a.type != b.type || a.index != b.index || a.get.ptr != b.get.ptr ||
+        a.set.ptr != b.set.ptr) {
+      printf("Lookup mismatch for '%s'\n", names[i]);
+      return;
+    }
+  }
+
+  double scan = _bench(_find_var_scan, names, var_code_count);
+  double hash = _bench(_find_var, names, var_code_count);
+
+  printf("Var lookups per second: scan %.0f, hash %.0f, %.1fx\n",
+         scan, hash, hash / scan);
+}
+#endif // __AVR__
+
+
 static type_u _get(type_t type, int8_t index, get_cb_u cb) {
   type_u value;
 
@@ -273,7 +587,7 @@ static type_u _get(type_t type, int8_t index, get_cb_u cb) {
 #define TYPEDEF(TYPE, ...)                                              \
     case TYPE_##TYPE:                                                   \
       if (index == -1) value._##TYPE = cb.get_##TYPE();                 \
-      value._##TYPE = cb.get_##TYPE##_index(index);                     \
+      else value._##TYPE = cb.get_##TYPE##_index(index);                \
       break;
 #include "type.def"
 #undef TYPEDEF
@@ -338,6 +652,256 @@ void vars_print_json() {
 }
 
 
+// Config blob: [version][entries...], entry: [code][index][raw value]
+static struct {
+  bool valid;
+  uint16_t length;
+  uint8_t data[CONFIG_BLOB_SIZE];
+} _blob = {0,};
+
+
+// Check and optionally set one entry, advances @param ptr past it
+static stat_t _entry_apply(const uint8_t **ptr, const uint8_t *end,
+                           bool apply) {
+  if (end - *ptr < 2) return STAT_CONFIG_BLOB_INVALID;
+  uint8_t code = *(*ptr)++;
+  uint8_t index = *(*ptr)++;
+  if (var_code_count <= code) return STAT_UNRECOGNIZED_NAME;
+
+  var_def_t def;
+  memcpy_P(&def, &_var_defs[code], sizeof(def));
+  if (!def.set) return STAT_READ_ONLY;
+  if (def.labels ? strlen(def.labels) <= index : index)
+    return STAT_CONFIG_BLOB_INVALID;
+
+  type_u value;
+  uint8_t size = type_unpack((type_t)def.type, &value, *ptr, end - *ptr);
+  if (!size) return STAT_INVALID_TYPE;
+  *ptr += size;
+
+  if (apply) {
+    set_cb_u cb;
+    cb.ptr = def.set;
+    _set((type_t)def.type, def.labels ? index : -1, cb, value);
+    _set_configured(code, index);
+  }
+
+  return STAT_OK;
+}
+
+
+static stat_t _blob_apply(bool apply) {
+  const uint8_t *ptr = _blob.data + 1;
+  const uint8_t *end = _blob.data + _blob.length;
+
+  while (ptr < end) {
+    stat_t status = _entry_apply(&ptr, end, apply);
+    if (status != STAT_OK) return status;
+  }
+
+  return STAT_OK;
+}
+
+
+// Config snapshot in EEPROM: header then entries as in config blobs.  The
+// entries hold the current value of every var set by a config blob, since
+// boot or from the restored snapshot.  The header is written last so an
+// interrupted write leaves no snapshot.  Entries are keyed by var code
+// index so a snapshot from firmware with different vars is not restored.
+typedef struct {
+  uint8_t version;
+  uint16_t length;
+  uint16_t crc;
+  uint32_t hash;
+  uint16_t layout;              // Var layout CRC
+} snapshot_header_t;
+
+
+static uint8_t _snapshot[CONFIG_EEPROM_SIZE] EEMEM;
+
+
+typedef enum {
+  SNAPSHOT_IDLE,
+  SNAPSHOT_INVALIDATE,
+  SNAPSHOT_ENTRIES,
+  SNAPSHOT_HEADER,
+} snapshot_state_t;
+
+
+static struct {
+  uint32_t hash;                // Hash of the config in EEPROM, 0 if none
+  snapshot_state_t state;
+  snapshot_header_t header;     // Header being written
+  uint16_t offset;              // Next EEPROM byte to write
+  uint8_t code;                 // Next var to write
+  uint8_t index;
+  uint8_t entry[6];
+  uint8_t entry_length;
+  uint8_t entry_offset;
+} _snap = {0,};
+
+
+// Stop writing, a partly written snapshot was already invalidated
+static void _snapshot_cancel() {
+  _snap.hash = 0;
+  _snap.state = SNAPSHOT_IDLE;
+}
+
+
+static void _snapshot_restore() {
+  snapshot_header_t header;
+  uint8_t *h = (uint8_t *)&header;
+  for (unsigned i = 0; i < sizeof(header); i++)
+    h[i] = eeprom_read_byte(&_snapshot[i]);
+
+  if (header.version != CONFIG_BLOB_VERSION || header.layout != _var_layout ||
+      CONFIG_EEPROM_SIZE - sizeof(header) < header.length) return;
+
+  const uint8_t *data = _snapshot + sizeof(header);
+  uint16_t crc = 0xffff;
+  for (uint16_t i = 0; i < header.length; i++)
+    crc = _crc16_update(crc, eeprom_read_byte(&data[i]));
+  if (crc != header.crc) return;
+
+  // Validate every entry before setting any
+  for (int pass = 0; pass < 2; pass++)
+    for (uint16_t offset = 0; offset < header.length;) {
+      uint8_t entry[6];
+      uint16_t len = header.length - offset;
+      if (sizeof(entry) < len) len = sizeof(entry);
+      for (uint8_t i = 0; i < len; i++)
+        entry[i] = eeprom_read_byte(&data[offset + i]);
+
+      const uint8_t *ptr = entry;
+      if (_entry_apply(&ptr, entry + len, pass) != STAT_OK) return;
+      offset += ptr - entry;
+    }
+
+  _snap.hash = header.hash;
+}
+
+
+// Pack the next snapshot var, returns false when there are no more
+static bool _snapshot_next_entry() {
+  for (; _snap.code < var_code_count; _snap.code++, _snap.index = 0) {
+    var_def_t def;
+    memcpy_P(&def, &_var_defs[_snap.code], sizeof(def));
+    uint8_t count = def.labels ? strlen(def.labels) : 1;
+
+    while (_snap.index < count) {
+      uint8_t index = _snap.index++;
+      if (!_is_configured(_snap.code, index)) continue;
+
+      get_cb_u cb;
+      cb.ptr = def.get;
+      type_u value = _get((type_t)def.type, def.labels ? index : -1, cb);
+
+      _snap.entry[0] = _snap.code;
+      _snap.entry[1] = index;
+      uint8_t size = type_pack((type_t)def.type, value, _snap.entry + 2,
+                               sizeof(_snap.entry) - 2);
+      if (!size) continue; // Strings are not saved
+
+      _snap.entry_length = size + 2;
+      _snap.entry_offset = 0;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+static void _snapshot_write(uint16_t offset, uint8_t value) {
+  eeprom_update_byte(&_snapshot[offset], value);
+}
+
+
+// Writes a few EEPROM bytes per call so the main loop is not blocked
+static void _snapshot_callback() {
+  for (int i = 0; i < 16 && _snap.state != SNAPSHOT_IDLE; i++) {
+    if (!eeprom_is_ready()) return;
+
+    switch (_snap.state) {
+    case SNAPSHOT_IDLE: break;
+
+    case SNAPSHOT_INVALIDATE:
+      _snapshot_write(0, 0xff);
+      _snap.header.version = CONFIG_BLOB_VERSION;
+      _snap.header.length = 0;
+      _snap.header.crc = 0xffff;
+      _snap.header.layout = _var_layout;
+      _snap.code = _snap.index = _snap.entry_length = _snap.entry_offset = 0;
+      _snap.offset = sizeof(snapshot_header_t);
+      _snap.state = SNAPSHOT_ENTRIES;
+      break;
+
+    case SNAPSHOT_ENTRIES: {
+      if (_snap.entry_offset == _snap.entry_length &&
+          !_snapshot_next_entry()) {
+        _snap.offset = 1; // Write the version byte last
+        _snap.state = SNAPSHOT_HEADER;
+        break;
+      }
+
+      if (_snap.offset == CONFIG_EEPROM_SIZE) {
+        _snap.state = SNAPSHOT_IDLE; // Too big, leave it invalid
+        break;
+      }
+
+      uint8_t value = _snap.entry[_snap.entry_offset++];
+      _snap.header.crc = _crc16_update(_snap.header.crc, value);
+      _snap.header.length++;
+      _snapshot_write(_snap.offset++, value);
+      break;
+    }
+
+    case SNAPSHOT_HEADER: {
+      const uint8_t *h = (const uint8_t *)&_snap.header;
+
+      if (_snap.offset == sizeof(snapshot_header_t)) {
+        _snapshot_write(0, h[0]);
+        _snap.hash = _snap.header.hash;
+        _snap.state = SNAPSHOT_IDLE;
+
+      } else {
+        _snapshot_write(_snap.offset, h[_snap.offset]);
+        _snap.offset++;
+      }
+      break;
+    }
+    }
+  }
+}
+
+
+void vars_callback() {_snapshot_callback();}
+
+
+static stat_t _blob_end(uint16_t crc) {
+  if (!_blob.valid || !_blob.length) return STAT_CONFIG_BLOB_INVALID;
+  if (_blob.data[0] != CONFIG_BLOB_VERSION) return STAT_CONFIG_BLOB_VERSION;
+
+  uint16_t check = 0xffff;
+  for (uint16_t i = 0; i < _blob.length; i++)
+    check = _crc16_update(check, _blob.data[i]);
+  if (check != crc) return STAT_CONFIG_BLOB_CHECKSUM;
+
+  // Validate every entry before setting any
+  stat_t status = _blob_apply(false);
+  if (status == STAT_OK) {
+    _blob_apply(true);
+    _snapshot_cancel(); // Config no longer matches the snapshot
+  }
+
+  return status;
+}
+
+
+// Var callbacks
+uint32_t get_config_hash() {return _snap.hash;}
+
+
 // Command callbacks
 stat_t command_var(char *cmd) {
   cmd++; // Skip command code
@@ -402,10 +966,96 @@ void command_sync_var_exec(void *data) {
 
 
 stat_t command_report(char *cmd) {
-  bool enable = cmd[1] != '0';
+  if (cmd[1] == 'b') {
+    _frame.enabled = cmd[2] != '0';
+    return STAT_OK;
+  }
 
-  if (cmd[2]) vars_report_var(cmd + 2, enable);
-  else vars_report_all(enable);
+  if (cmd[1] == 'z') { // Deadband: z<var>=<abs>[,<rel>]
+    char *value = strchr(cmd + 2, '=');
+    if (!value) return STAT_INVALID_ARGUMENTS;
+    *value++ = 0;
+
+    int code = _find_code(cmd + 2);
+    if (code == -1) return STAT_UNRECOGNIZED_NAME;
+    deadband_t *db = (deadband_t *)pgm_read_ptr(&_deadbands[code]);
+    if (!db) return STAT_INVALID_TYPE;
+
+    char *end;
+    float absolute = strtod(value, &end);
+    float relative = 0;
+    if (*end == ',') relative = strtod(end + 1, &end);
+    if (end == value || *end || !(0 <= absolute) || !(0 <= relative))
+      return STAT_INVALID_VALUE;
+
+    db->abs = absolute;
+    db->rel = relative;
+    return STAT_OK;
+  }
+
+  int8_t rc;
+  switch (tolower(cmd[1])) {
+  case '0': rc = REPORT_OFF; break;
+  case '1': case 'n': rc = REPORT_NORMAL; break;
+  case 'f': rc = REPORT_FAST; break;
+  case 's': rc = REPORT_SLOW; break;
+  case 'c': rc = REPORT_CHANGE; break;
+  case 'd': rc = -1; break;
+  default: return STAT_INVALID_ARGUMENTS;
+  }
+
+  if (cmd[2]) vars_report_var(cmd + 2, rc);
+  else vars_report_all(rc);
 
   return STAT_OK;
 }
+
+
+stat_t command_config(char *cmd) {
+  switch (cmd[1]) {
+  case 'b': // Begin
+    _blob.valid = true;
+    _blob.length = 0;
+    return STAT_OK;
+
+  case 'd': { // Base64 data
+    unsigned len = strlen(cmd + 2);
+    unsigned size = len / 4 * 3 + (len % 4 ? len % 4 - 1 : 0);
+
+    if (!_blob.valid) return STAT_CONFIG_BLOB_INVALID;
+    _blob.valid = false;
+
+    if (CONFIG_BLOB_SIZE < _blob.length + size)
+      return STAT_CONFIG_BLOB_INVALID;
+    if (!b64_decode(cmd + 2, len, _blob.data + _blob.length))
+      return STAT_INVALID_VALUE;
+
+    _blob.valid = true;
+    _blob.length += size;
+    return STAT_OK;
+  }
+
+  case 'h': { // Save applied config to EEPROM with the host's hash
+    char *end;
+    uint32_t hash = strtoul(cmd + 2, &end, 16);
+    if (end == cmd + 2 || *end || !hash) return STAT_INVALID_ARGUMENTS;
+
+    _snap.header.hash = hash;
+    _snap.hash = 0;
+    _snap.state = SNAPSHOT_INVALIDATE;
+    return STAT_OK;
+  }
+
+  case 'e': { // End, check and apply
+    char *end;
+    uint16_t crc = strtoul(cmd + 2, &end, 16);
+    if (end == cmd + 2 || *end) return STAT_INVALID_ARGUMENTS;
+
+    stat_t status = _blob_end(crc);
+    _blob.valid = false;
+    return status;
+  }
+  }
+
+  return STAT_INVALID_ARGUMENTS;
+}
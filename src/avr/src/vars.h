@@ -30,16 +30,22 @@
 #include "status.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 
 
 float var_decode_float(const char *value);
 bool var_parse_bool(const char *value);
 
 void vars_init();
+void vars_callback();
 
-void vars_report(bool full);
-void vars_report_all(bool enable);
-void vars_report_var(const char *code, bool enable);
+void vars_report(uint8_t classes, bool full);
+void vars_report_all(int8_t rc);
+void vars_report_var(const char *code, int8_t rc);
 stat_t vars_print(const char *name);
 stat_t vars_set(const char *name, const char *value);
 void vars_print_json();
+
+#ifndef __AVR__
+void vars_benchmark();
+#endif
@@ -61,6 +61,9 @@ typedef enum {
   REG_STATUS_READ,
 
   REG_DISCONNECT_WRITE,
+
+  REG_CURRENT_READ,
+  REG_TEMP_READ,
 } vfd_reg_type_t;
 
 
@@ -68,6 +71,8 @@ typedef struct {
   vfd_reg_type_t type;
   uint16_t addr;
   uint16_t value;
+  uint8_t period; // Polled every period queries, 0 is the same as 1
+  bool solo;      // Polled reads which must not be batched with others
   uint8_t fails;
 } vfd_reg_t;
 
@@ -75,6 +80,22 @@ typedef struct {
 #define P(H, L) ((H) << 8 | (L))
 
 
+// Huanyang is not Modbus compliant, see _huanyang_func() and modbus.h.
+// Reads are addressed by parameter number or control read address.
+const vfd_reg_t huanyang_regs[] PROGMEM = {
+  {REG_MAX_FREQ_READ,     5,  0},     // PD005 Max frequency
+  {REG_FREQ_SET,          0,  0},     // Frequency
+  {REG_STOP_WRITE,        0,  8},     // Stop
+  {REG_FWD_WRITE,         0,  3},     // Run forward
+  {REG_REV_WRITE,         0, 17},     // Run reverse
+  {REG_FREQ_READ,         1,  0},     // Actual freq
+  {REG_CURRENT_READ,      2,  0,  2}, // Actual current
+  {REG_TEMP_READ,         7,  0, 10}, // Temperature
+  {REG_DISCONNECT_WRITE,  0,  8},     // Stop
+  {REG_DISABLED},
+};
+
+
 // NOTE, Modbus reg = AC Tech reg + 1
 const vfd_reg_t ac_tech_regs[] PROGMEM = {
   {REG_CONNECT_WRITE,    48,   19}, // Password unlock
@@ -198,132 +219,169 @@ const vfd_reg_t dmm_dyn4_regs[] PROGMEM = {
 static vfd_reg_t regs[VFDREG];
 static vfd_reg_t custom_regs[VFDREG];
 
+
+typedef struct {
+  uint16_t requests;
+  uint16_t timeouts;
+  uint16_t crc_errs;
+  uint16_t retries;
+  uint16_t latency[VFD_LATENCY_BINS]; // Round trips by duration
+} vfd_stats_t;
+
+static vfd_stats_t stats[VFDTYPE];
+
 static struct {
-  vfd_reg_type_t state;
-  int8_t reg;
-  uint8_t read_count;
+  vfd_reg_type_t state;  // Step of the connect and update sequence
+  uint8_t reg;           // Next register of the current step to queue
+  uint8_t pending;       // Register results the current step is waiting for
+  int8_t poll_reg;       // Next register to poll, -1 if not polling
+  uint8_t polls;         // Register results polling is waiting for
   bool changed;
+  bool reconfigure;
   bool shutdown;
+  bool failed;
 
   float power;
+  float target;          // Power being set
   uint16_t max_freq;
   bool user_multi_write;
   float actual_power;
   uint16_t status;
+  uint16_t current;
+  uint16_t temperature;
 
-  uint32_t wait;
+  uint8_t poll_count;    // Queries so far, for registers polled less often
+  uint32_t next_poll;
   deinit_cb_t deinit_cb;
 } vfd;
 
 
 static void _disconnected() {
   modbus_deinit();
+  vfd.state = REG_DISABLED;
   if (vfd.deinit_cb) vfd.deinit_cb();
   vfd.deinit_cb = 0;
 }
 
 
-static bool _next_state() {
-  switch (vfd.state) {
-  case REG_MAX_FREQ_FIXED:
-    if (!vfd.power) vfd.state = REG_STOP_WRITE;
-    else vfd.state = REG_FREQ_SET;
-    break;
+static bool _is_poll(vfd_reg_type_t type) {
+  switch (type) {
+  case REG_FREQ_READ: case REG_FREQ_SIGN_READ: case REG_FREQ_ACTECH_READ:
+  case REG_STATUS_READ: case REG_CURRENT_READ: case REG_TEMP_READ: return true;
+  default: return false;
+  }
+}
 
-  case REG_FREQ_SIGN_SET:
-    if (vfd.power < 0) vfd.state = REG_REV_WRITE;
-    else if (0 < vfd.power) vfd.state = REG_FWD_WRITE;
-    else vfd.state = REG_STOP_WRITE;
-    break;
 
-  case REG_STOP_WRITE: case REG_FWD_WRITE: case REG_REV_WRITE:
-    vfd.state = REG_FREQ_READ;
-    break;
+static bool _is_huanyang() {
+  return spindle_get_type() == SPINDLE_TYPE_HUANYANG;
+}
 
-  case REG_STATUS_READ:
-    if (vfd.shutdown || estop_triggered()) vfd.state = REG_DISCONNECT_WRITE;
 
-    else if (vfd.changed) {
-      // Update frequency and state
-      vfd.changed = false;
-      vfd.state = REG_MAX_FREQ_READ;
+static uint8_t _words(vfd_reg_type_t type) {
+  return type == REG_FREQ_ACTECH_READ ? 6 : 1;
+}
+
+
+static void _count(uint16_t &counter, uint8_t n) {
+  counter = n < 0xffff - counter ? counter + n : 0xffff;
+}
 
-    } else {
-      // Continue querying after delay
-      vfd.state = REG_FREQ_READ;
-      vfd.wait = rtc_get_time() + VFD_QUERY_DELAY;
-      return false;
-    }
-    break;
 
-  case REG_DISCONNECT_WRITE:
-    _disconnected();
-    return false;
+/// Count a request to a register of @param type
+static void _record(vfd_reg_type_t type, bool ok) {
+  vfd_stats_t &s = stats[type];
+  const modbus_transfer_t *xfer = modbus_get_transfer();
 
-  default:
-    vfd.state = (vfd_reg_type_t)(vfd.state + 1);
+  _count(s.requests, 1);
+  _count(s.timeouts, xfer->timedout);
+  _count(s.crc_errs, xfer->crc_errs);
+  _count(s.retries, xfer->retries);
+  if (!ok) return;
+
+  // Bins double in length, the last one holds everything longer
+  uint32_t limit = (uint32_t)RTC_FREQ * VFD_LATENCY_MIN / 1000;
+  uint8_t bin = 0;
+  while (bin < VFD_LATENCY_BINS - 1 && limit <= xfer->latency) {
+    limit <<= 1;
+    bin++;
   }
 
-  return true;
+  _count(s.latency[bin], 1);
 }
 
 
-static bool _exec_command();
+static void _fail(uint16_t addr, bool poll) {
+  for (int i = 0; i < VFDREG; i++)
+    if (regs[i].addr == addr && regs[i].fails < 255 &&
+        (poll ? _is_poll(regs[i].type) : regs[i].type == vfd.state))
+      regs[i].fails++;
 
+  vfd.failed = true;
+}
 
-static void _next_reg() {
-  while (true) {
-    vfd.reg++;
 
-    if (vfd.reg == VFDREG) {
-      vfd.reg = -1;
-      vfd.read_count = 0;
-      if (!_next_state()) break;
+static void _state_cb(bool ok, uint16_t addr, uint16_t value) {
+  _record(vfd.state, ok);
 
-    } else if (regs[vfd.reg].type == vfd.state && _exec_command()) break;
+  if (!ok) {
+    _fail(addr, false);
+    return;
   }
-}
 
+  if (vfd.pending) vfd.pending--;
 
-static void _connect() {
-  vfd.state = REG_CONNECT_WRITE;
-  vfd.reg = -1;
-  _next_reg();
+  switch (vfd.state) {
+  case REG_MAX_FREQ_READ: vfd.max_freq = value; break;
+
+  case REG_STOP_WRITE: case REG_FWD_WRITE: case REG_REV_WRITE:
+    if (_is_huanyang()) vfd.status = value; // Control writes return status
+    break;
+
+  default: break;
+  }
 }
 
 
-static void _modbus_cb(bool ok, uint16_t addr, uint16_t value) {
-  // Handle error
+static void _poll_cb(bool ok, uint16_t addr, uint16_t value) {
+  // Coalesced reads return each register, count the first of each request
+  for (int i = 0; i < VFDREG; i++)
+    if (regs[i].addr == addr && _is_poll(regs[i].type))
+      _record(regs[i].type, ok);
+
   if (!ok) {
-    if (regs[vfd.reg].fails < 255) regs[vfd.reg].fails++;
-    if (vfd.shutdown || estop_triggered()) _disconnected();
-    else _connect();
+    _fail(addr, true);
     return;
   }
 
-  // Handle read result
-  vfd.read_count++;
+  if (vfd.polls) vfd.polls--;
 
-  switch (regs[vfd.reg].type) {
-  case REG_MAX_FREQ_READ: vfd.max_freq = value; break;
-  case REG_FREQ_READ: vfd.actual_power = value / (float)vfd.max_freq; break;
+  // Reads are coalesced so match results by address
+  for (int i = 0; i < VFDREG; i++) {
+    const vfd_reg_t &reg = regs[i];
 
-  case REG_FREQ_SIGN_READ:
-    vfd.actual_power = (int16_t)value / (float)vfd.max_freq;
-    break;
+    switch (reg.type) {
+    case REG_FREQ_READ:
+      if (addr == reg.addr) vfd.actual_power = value / (float)vfd.max_freq;
+      break;
 
-  case REG_FREQ_ACTECH_READ:
-    if (vfd.read_count == 2) vfd.actual_power = value / (float)vfd.max_freq;
-    if (vfd.read_count < 6) return;
-    break;
+    case REG_FREQ_SIGN_READ:
+      if (addr == reg.addr)
+        vfd.actual_power = (int16_t)value / (float)vfd.max_freq;
+      break;
 
-  case REG_STATUS_READ: vfd.status = value; break;
+    case REG_FREQ_ACTECH_READ:
+      if (addr == reg.addr + 1)
+        vfd.actual_power = value / (float)vfd.max_freq;
+      break;
 
-  default: break;
-  }
+    case REG_STATUS_READ: if (addr == reg.addr) vfd.status = value; break;
+    case REG_CURRENT_READ: if (addr == reg.addr) vfd.current = value; break;
+    case REG_TEMP_READ: if (addr == reg.addr) vfd.temperature = value; break;
 
-  // Next
-  _next_reg();
+    default: break;
+    }
+  }
 }
 
 
@@ -336,54 +394,122 @@ static bool _use_multi_write() {
 }
 
 
-static bool _exec_command() {
-  if (vfd.wait) return true;
+static huanyang_func_t _huanyang_func(vfd_reg_type_t type) {
+  switch (type) {
+  case REG_CONNECT_WRITE: return HUANYANG_FUNC_WRITE;
+  case REG_MAX_FREQ_READ: return HUANYANG_FUNC_READ;
+  case REG_FREQ_SET:      return HUANYANG_FREQ_WRITE;
+  default: return _is_poll(type) ? HUANYANG_CTRL_READ : HUANYANG_CTRL_WRITE;
+  }
+}
 
-  vfd_reg_t reg = regs[vfd.reg];
-  uint16_t words = 1;
-  bool read = false;
-  bool write = false;
+
+/// Queue one register, returns false if the Modbus queue is full
+static bool _queue(int i, modbus_prio_t prio, modbus_rw_cb_t cb) {
+  vfd_reg_t reg = regs[i];
 
   switch (reg.type) {
-  case REG_DISABLED: break;
+  case REG_FREQ_SET: reg.value = fabs(vfd.target) * vfd.max_freq; break;
+  case REG_FREQ_SIGN_SET: reg.value = vfd.target * vfd.max_freq; break;
+  default: break;
+  }
 
-  case REG_MAX_FREQ_FIXED: vfd.max_freq = reg.value; break;
+  if (_is_huanyang())
+    return modbus_huanyang(_huanyang_func(reg.type), reg.addr, reg.value, prio,
+                           cb);
 
-  case REG_FREQ_SET:
-    write = true;
-    reg.value = fabs(vfd.power) * vfd.max_freq;
-    break;
+  if (reg.type == REG_MAX_FREQ_READ || _is_poll(reg.type))
+    return modbus_read(reg.addr, _words(reg.type), !reg.solo, prio, cb);
 
+  return (_use_multi_write() ? modbus_multi_write : modbus_write)
+    (reg.addr, reg.value, prio, cb);
+}
+
+
+// Queue the registers of the current step as space allows
+static void _fill_state() {
+  for (; vfd.reg < VFDREG; vfd.reg++) {
+    if (regs[vfd.reg].type != vfd.state) continue;
+
+    if (vfd.state == REG_MAX_FREQ_FIXED) vfd.max_freq = regs[vfd.reg].value;
+    else if (_queue(vfd.reg, MODBUS_PRIO_CONTROL, _state_cb))
+      vfd.pending += _words(vfd.state);
+    else break;
+  }
+}
+
+
+static vfd_reg_type_t _next_state() {
+  switch (vfd.state) {
   case REG_FREQ_SIGN_SET:
-    write = true;
-    reg.value = vfd.power * vfd.max_freq;
-    break;
+    if (vfd.target < 0) return REG_REV_WRITE;
+    if (0 < vfd.target) return REG_FWD_WRITE;
+    return REG_STOP_WRITE;
 
-  case REG_CONNECT_WRITE:
-  case REG_STOP_WRITE:
-  case REG_FWD_WRITE:
-  case REG_REV_WRITE:
-  case REG_DISCONNECT_WRITE:
-    write = true;
-    break;
+  case REG_STOP_WRITE: case REG_FWD_WRITE: case REG_REV_WRITE:
+    return REG_FREQ_READ;
+
+  case REG_FREQ_READ: // Running
+    if (vfd.shutdown || estop_triggered()) return REG_DISCONNECT_WRITE;
+    if (vfd.reconfigure) return REG_MAX_FREQ_READ;
+    if (vfd.changed) return REG_FREQ_SET;
+    return REG_FREQ_READ;
+
+  default: return (vfd_reg_type_t)(vfd.state + 1);
+  }
+}
+
+
+static void _enter_state(vfd_reg_type_t state) {
+  switch (state) {
+  case REG_MAX_FREQ_READ: vfd.reconfigure = false; break;
 
-  case REG_FREQ_ACTECH_READ:
-    words = 6;
+  case REG_FREQ_SET:
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      vfd.target = vfd.power;
+      vfd.changed = false;
+    }
 
-  case REG_FREQ_READ:
-  case REG_FREQ_SIGN_READ:
-  case REG_MAX_FREQ_READ:
-  case REG_STATUS_READ:
-    read = true;
+    if (!vfd.target) state = REG_STOP_WRITE;
     break;
+
+  default: break;
+  }
+
+  vfd.state = state;
+  vfd.reg = state == REG_FREQ_READ ? VFDREG : 0; // Running regs are polled
+}
+
+
+static void _connect() {
+  modbus_flush();
+  vfd.pending = vfd.polls = 0;
+  vfd.poll_reg = -1;
+  _enter_state(REG_CONNECT_WRITE);
+}
+
+
+// Poll status at a fixed rate while running, updates pre-empt polls
+static void _poll() {
+  if (vfd.poll_reg == -1) {
+    if (vfd.state != REG_FREQ_READ || vfd.polls || !rtc_expired(vfd.next_poll))
+      return;
+
+    vfd.poll_reg = 0;
+    vfd.poll_count++;
+    vfd.next_poll = rtc_get_time() + VFD_QUERY_DELAY;
   }
 
-  if (read) modbus_read(reg.addr, words, _modbus_cb);
-  else if (write) (_use_multi_write() ? modbus_multi_write : modbus_write)
-                    (reg.addr, reg.value, _modbus_cb);
-  else return false;
+  for (; vfd.poll_reg < VFDREG; vfd.poll_reg++) {
+    const vfd_reg_t &reg = regs[vfd.poll_reg];
+    vfd_reg_type_t type = reg.type;
+    if (!_is_poll(type) || (reg.period && vfd.poll_count % reg.period))
+      continue;
+    if (!_queue(vfd.poll_reg, MODBUS_PRIO_POLL, _poll_cb)) return;
+    vfd.polls += _words(type);
+  }
 
-  return true;
+  vfd.poll_reg = -1;
 }
 
 
@@ -395,6 +521,8 @@ static void _load(const vfd_reg_t *_regs) {
     if (!regs[i].type) break;
     regs[i].addr = pgm_read_word(&_regs[i].addr);
     regs[i].value = pgm_read_word(&_regs[i].value);
+    regs[i].period = pgm_read_byte(&_regs[i].period);
+    regs[i].solo = pgm_read_byte(&_regs[i].solo);
   }
 }
 
@@ -406,6 +534,7 @@ void vfd_spindle_init() {
 
   switch (spindle_get_type()) {
   case SPINDLE_TYPE_CUSTOM:  memcpy(regs, custom_regs, sizeof(regs)); break;
+  case SPINDLE_TYPE_HUANYANG:         _load(huanyang_regs);           break;
   case SPINDLE_TYPE_AC_TECH:          _load(ac_tech_regs);            break;
   case SPINDLE_TYPE_NOWFOREVER:       _load(nowforever_regs);         break;
   case SPINDLE_TYPE_DELTA_VFD015M21A: _load(delta_vfd015m21a_regs);   break;
@@ -442,10 +571,36 @@ float vfd_spindle_get() {return vfd.actual_power;}
 uint16_t vfd_get_status() {return vfd.status;}
 
 
-void vfd_spindle_rtc_callback() {
-  if (!vfd.wait || !rtc_expired(vfd.wait)) return;
-  vfd.wait = 0;
-  _next_reg();
+
+void vfd_spindle_callback() {
+  if (vfd.state == REG_DISABLED) return;
+
+  if (vfd.failed) {
+    vfd.failed = false;
+    if (vfd.shutdown || estop_triggered()) {
+      _disconnected();
+      return;
+    }
+
+    _connect();
+  }
+
+  // Advance through the connect and update steps
+  while (true) {
+    _fill_state();
+    if (vfd.reg < VFDREG || vfd.pending) break;
+
+    if (vfd.state == REG_DISCONNECT_WRITE) {
+      _disconnected();
+      return;
+    }
+
+    vfd_reg_type_t next = _next_state();
+    if (next == REG_FREQ_READ && vfd.state == REG_FREQ_READ) break;
+    _enter_state(next);
+  }
+
+  _poll();
 }
 
 
@@ -461,7 +616,7 @@ void set_vfd_reg_type(int reg, uint8_t type) {
   custom_regs[reg].type = (vfd_reg_type_t)type;
   if (spindle_get_type() == SPINDLE_TYPE_CUSTOM)
     regs[reg].type = custom_regs[reg].type;
-  vfd.changed = true;
+  vfd.reconfigure = true;
 }
 
 
@@ -472,7 +627,7 @@ void set_vfd_reg_addr(int reg, uint16_t addr) {
   custom_regs[reg].addr = addr;
   if (spindle_get_type() == SPINDLE_TYPE_CUSTOM)
     regs[reg].addr = custom_regs[reg].addr;
-  vfd.changed = true;
+  vfd.reconfigure = true;
 }
 
 
@@ -483,7 +638,7 @@ void set_vfd_reg_val(int reg, uint16_t value) {
   custom_regs[reg].value = value;
   if (spindle_get_type() == SPINDLE_TYPE_CUSTOM)
     regs[reg].value = custom_regs[reg].value;
-  vfd.changed = true;
+  vfd.reconfigure = true;
 }
 
 
@@ -493,3 +648,29 @@ uint8_t get_vfd_reg_fails(int reg) {return regs[reg].fails;}
 void set_vfd_reg_fails(int reg, uint8_t value) {
   regs[reg].fails = value;
 }
+
+
+// Huanyang variables, its frequencies are in 0.01Hz and current in 0.01A
+float get_hy_freq() {return vfd.actual_power * vfd.max_freq * 0.01;}
+float get_hy_current() {return vfd.current * 0.01;}
+uint16_t get_hy_temp() {return vfd.temperature;}
+float get_hy_max_freq() {return vfd.max_freq * 0.01;}
+
+
+uint16_t get_vfd_requests(int type) {return stats[type].requests;}
+
+
+void set_vfd_requests(int type, uint16_t value) {
+  memset(&stats[type], 0, sizeof(vfd_stats_t));
+}
+
+
+uint16_t get_vfd_timeouts(int type) {return stats[type].timeouts;}
+uint16_t get_vfd_crc_errs(int type) {return stats[type].crc_errs;}
+uint16_t get_vfd_retries(int type) {return stats[type].retries;}
+uint16_t get_vfd_lat_4ms(int type) {return stats[type].latency[0];}
+uint16_t get_vfd_lat_8ms(int type) {return stats[type].latency[1];}
+uint16_t get_vfd_lat_16ms(int type) {return stats[type].latency[2];}
+uint16_t get_vfd_lat_32ms(int type) {return stats[type].latency[3];}
+uint16_t get_vfd_lat_64ms(int type) {return stats[type].latency[4];}
+uint16_t get_vfd_lat_max(int type) {return stats[type].latency[5];}
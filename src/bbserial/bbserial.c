@@ -37,6 +37,7 @@
 #include <linux/interrupt.h>
 #include <linux/spinlock.h>
 #include <linux/tty.h>
+#include <linux/serial.h>
 #include <asm/ioctls.h>
 #include <asm/termios.h>
 
@@ -498,6 +499,18 @@ static long _dev_ioctl(struct file *file, unsigned cmd, unsigned long arg) {
   case TIOCINQ:  return put_user(RING_BUF_FILL(_port.rx_buf), ptr);
   case TIOCOUTQ: return put_user(RING_BUF_FILL(_port.tx_buf), ptr);
 
+  case TIOCGICOUNT: { // Get error counters
+    struct serial_icounter_struct icount;
+    memset(&icount, 0, sizeof(icount));
+    icount.frame   = _port.frame_errs;
+    icount.overrun = _port.overruns;
+    icount.parity  = _port.parity_errs;
+    icount.brk     = _port.brk_errs;
+    if (copy_to_user((void __user *)arg, &icount, sizeof(icount)))
+      return -EFAULT;
+    return 0;
+  }
+
   default: return -ENOIOCTLCMD;
   }
 
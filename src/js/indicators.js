@@ -36,7 +36,9 @@ module.exports = {
 
 
   computed: {
-    modbus_status: function () {return modbus.status_to_string(this.state.mx)},
+    modbus_status: function () {
+      return modbus.status_to_string(this.state.mx, this.state.mz)
+    },
 
 
     sense_error: function () {
@@ -34,16 +34,31 @@ var exports = {
   OK:           1,
   CRC:          2,
   INVALID:      3,
-  TIMEDOUT:     4
+  TIMEDOUT:     4,
+  EXCEPTION:    5
+};
+
+
+var exceptions = {
+  1: 'illegal function',
+  2: 'illegal address',
+  3: 'illegal value',
+  4: 'device failure',
+  6: 'device busy'
 };
 
 
 exports.status_to_string =
-  function (status) {
+  function (status, exception) {
     if (status == exports.OK)       return 'Ok';
     if (status == exports.CRC)      return 'CRC error';
     if (status == exports.INVALID)  return 'Invalid response';
     if (status == exports.TIMEDOUT) return 'Timedout';
+
+    if (status == exports.EXCEPTION)
+      return 'Exception ' + exception +
+        (exceptions[exception] ? ', ' + exceptions[exception] : '');
+
     return 'Disconnected';
   }
 
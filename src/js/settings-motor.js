@@ -54,11 +54,32 @@ module.exports = {
     },
 
 
-    maxMaxVelocity: function () {
+    coarseEnabled: function () {
+      var coarse = this.motor['coarse-microsteps'];
+      return coarse && coarse < this.motor['microsteps'] &&
+        this.motor['coarse-velocity'];
+    },
+
+
+    fineMaxVelocity: function () {
       return 1 * (15 * this.umPerStep / this.motor['microsteps']).toFixed(3);
     },
 
 
+    maxMaxVelocity: function () {
+      // Coarse microsteps allow higher step rates
+      if (!this.coarseEnabled) return this.fineMaxVelocity;
+      var coarse = this.motor['coarse-microsteps'];
+      return 1 * (15 * this.umPerStep / coarse).toFixed(3);
+    },
+
+
+    invalidCoarseVelocity: function () {
+      return this.coarseEnabled &&
+        this.fineMaxVelocity < this.motor['coarse-velocity'];
+    },
+
+
     ustepPerSec: function () {
       return this.rpm * this.stepsPerRev * this.motor['microsteps'] / 60;
     },
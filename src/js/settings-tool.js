@@ -39,7 +39,11 @@ module.exports = {
   data: function () {
     return {
       address: 0,
-      value: 0
+      value: 0,
+      latency_bins: [
+        {name: '<4ms', code: 'qa'}, {name: '<8ms', code: 'qb'},
+        {name: '<16ms', code: 'qc'}, {name: '<32ms', code: 'qd'},
+        {name: '<64ms', code: 'qe'}, {name: 'longer', code: 'qf'}]
     }
   },
 
@@ -65,7 +69,9 @@ module.exports = {
     },
 
 
-    modbus_status: function () {return modbus.status_to_string(this.state.mx)}
+    modbus_status: function () {
+      return modbus.status_to_string(this.state.mx, this.state.mz)
+    }
   },
 
 
@@ -85,12 +91,20 @@ module.exports = {
     },
 
 
+    get_stat: function (type, code) {
+      return this.state[type.toString(16) + code] || 0
+    },
+
+
     show_modbus_field: function (key) {
       return key != 'regs' &&
         (key != 'multi-write' || this.tool_type == 'CUSTOM MODBUS VFD');
     },
 
 
+    change: function () {this.$dispatch('input-changed')},
+
+
     customize: function (e) {
       this.config.tool['tool-type'] = 'Custom Modbus VFD';
 
@@ -124,6 +138,12 @@ module.exports = {
       var regs = this.config['modbus-spindle'].regs;
       for (var reg = 0; reg < regs.length; reg++)
         this.$dispatch('send', '\$' + reg + 'vr=0');
+    },
+
+
+    reset_stats: function (e) {
+      for (var type = 0; type < 16; type++)
+        this.$dispatch('send', '\$' + type.toString(16) + 'mq=0');
     }
   }
 }
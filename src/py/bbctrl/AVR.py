@@ -29,6 +29,9 @@ import serial
 import time
 import traceback
 import ctypes
+import struct
+import fcntl
+import termios
 
 import bbctrl
 import bbctrl.Cmd as Cmd
@@ -58,9 +61,6 @@ class serial_struct(ctypes.Structure):
 
 
 def serial_set_low_latency(sp):
-    import fcntl
-    import termios
-
     ASYNCB_LOW_LATENCY = 13
 
     ss = serial_struct()
@@ -69,6 +69,14 @@ def serial_set_low_latency(sp):
     fcntl.ioctl(sp, termios.TIOCSSERIAL, ss)
 
 
+def serial_get_errors(sp):
+    TIOCGICOUNT = getattr(termios, 'TIOCGICOUNT', 0x545d)
+
+    # struct serial_icounter_struct
+    icount = struct.unpack('20i', fcntl.ioctl(sp, TIOCGICOUNT, bytes(80)))
+    return icount[6] + icount[7] # frame + overrun
+
+
 class AVR(object):
     def __init__(self, ctrl):
         self.ctrl = ctrl
@@ -116,6 +124,21 @@ class AVR(object):
         self.ctrl.ioloop.update_handler(self.sp, flags)
 
 
+    def can_set_baud(self): return self.sp is not None
+
+
+    def set_baud(self, baud):
+        self.log.info('Serial baud %d' % baud)
+        self.sp.baudrate = baud
+        self.sp.reset_input_buffer()
+
+
+    def get_errors(self):
+        try:
+            return serial_get_errors(self.sp)
+        except: return None # Not supported by driver
+
+
     def _serial_write(self):
         self.write_cb(lambda data: self.sp.write(data))
 
@@ -100,6 +100,8 @@ class AVREmu(object):
 
                 cmd = ['bbemu']
                 if self.ctrl.args.fast_emu: cmd.append('--fast')
+                if self.ctrl.args.emu_vfd:
+                    cmd += ['--vfd', self.ctrl.args.emu_vfd]
 
                 os.execvp(cmd[0], cmd)
                 os._exit(1) # In case of failure
@@ -148,6 +150,9 @@ class AVREmu(object):
         self.write_enabled = enable
 
 
+    def can_set_baud(self): return False
+
+
     def _avr_write(self, data):
         try:
             length = os.write(self.avrOut, data)
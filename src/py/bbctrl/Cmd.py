@@ -30,17 +30,23 @@
 import struct
 import base64
 import json
+import math
 
 # Keep this in sync with AVR code command.def
 SET          = '$'
 SET_SYNC     = '#'
+CONFIG       = 'K'
+ID           = '@'
 MODBUS_READ  = 'm'
 MODBUS_WRITE = 'M'
 SEEK         = 's'
 SET_AXIS     = 'a'
 LINE         = 'l'
+LINE_DELTA   = 'L'
 SYNC_SPEED   = '%'
 SPEED        = 'p'
+AT_SPEED     = 'w'
+SPINDLE_SYNC = 'y'
 INPUT        = 'I'
 DWELL        = 'd'
 PAUSE        = 'P'
@@ -48,8 +54,11 @@ STOP         = 'S'
 UNPAUSE      = 'U'
 JOG          = 'j'
 REPORT       = 'r'
+SCOPE        = 'T'
 REBOOT       = 'R'
 RESUME       = 'c'
+BAUD         = 'B'
+FLOW         = 'f'
 ESTOP        = 'E'
 SHUTDOWN     = 'X'
 CLEAR        = 'C'
@@ -57,10 +66,22 @@ FLUSH        = 'F'
 DUMP         = 'D'
 HELP         = 'h'
 
+# Keep this in sync with AVR code usart.h
+BAUD_PROBE = 'UUUU****3333ffff~~~~@@@@'
+BAUD_COMMIT = BAUD + '+'
+
 SEEK_ACTIVE = 1 << 0
 SEEK_ERROR  = 1 << 1
 
 
+B64_CHARS = \
+    'ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/'
+
+# Delta coded line targets, keep this in sync with AVR code line.c
+LINE_DELTA_DIGITS = 3
+LINE_DELTA_MAX = (1 << (LINE_DELTA_DIGITS * 6 - 1)) - 1
+
+
 def encode_float(x):
     return base64.b64encode(struct.pack('<f', x))[:-2].decode("utf-8")
 
@@ -69,6 +90,24 @@ def decode_float(s):
     return struct.unpack('<f', base64.b64decode(s + '=='))[0]
 
 
+def encode_int(x, digits):
+    s = ''
+    for i in range(digits):
+        s = B64_CHARS[x & 63] + s
+        x >>= 6
+    return s
+
+
+def decode_int(s):
+    x = 0
+    for c in s: x = x << 6 | B64_CHARS.index(c)
+    sign = 1 << (len(s) * 6 - 1)
+    return (x ^ sign) - sign
+
+
+def to_float32(x): return struct.unpack('<f', struct.pack('<f', x))[0]
+
+
 def encode_axes(axes):
     data = ''
     for axis in 'xyzabc':
@@ -86,27 +125,53 @@ def set_sync(name, value):
     else: return SET_SYNC + '%s=%s' % (name, value)
 
 
+def get(name): return SET + name
+
+
 def set(name, value):
     if isinstance(value, float): return set_float(name, value)
     else: return SET + '%s=%s' % (name, value)
 
 
+def with_id(id, cmd): return ID + '%d' % (id & 0xffff) + cmd
+
+
 def set_float(name, value):
     return SET_SYNC + '%s=:%s' % (name, encode_float(value))
 
 
+def config_begin(): return CONFIG + 'b'
+def config_end(crc): return CONFIG + 'e%04x' % crc
+def config_save(hash): return CONFIG + 'h%08x' % hash
+
+
+def config_data(data):
+    return CONFIG + 'd' + base64.b64encode(data).decode('utf-8').rstrip('=')
+
+
+def report_binary(enable): return REPORT + 'b' + ('1' if enable else '0')
+
+
+def scope_dump(): return SCOPE + 'd'
+def scope_cancel(): return SCOPE + 'c'
+
+
+def scope_arm(axes, trigger, arg = None):
+    # Triggers: n=now, i=line id, s=switch change, e=estop
+    cmd = SCOPE + 'a' + axes + trigger
+    if arg is not None: cmd += '%d' % arg
+    return cmd
+
+
+def baud(rate): return BAUD + '%d' % rate
+def baud_probe(): return BAUD + '!' + BAUD_PROBE
 def modbus_read(addr): return MODBUS_READ + '%d' % addr
 def modbus_write(addr, value): return MODBUS_WRITE + '%d=%d' % (addr, value)
 def set_axis(axis, position): return SET_AXIS + axis + encode_float(position)
 
 
-def line(target, exitVel, maxAccel, maxJerk, times, speeds):
-    cmd = LINE
-
-    cmd += encode_float(exitVel)
-    cmd += encode_float(maxAccel)
-    cmd += encode_float(maxJerk)
-    cmd += encode_axes(target)
+def _encode_line_times(times, speeds):
+    cmd = ''
 
     # S-Curve time parameters
     for i in range(7):
@@ -120,6 +185,101 @@ def line(target, exitVel, maxAccel, maxJerk, times, speeds):
     return cmd
 
 
+def line(target, exitVel, maxAccel, maxJerk, times, speeds):
+    cmd = LINE
+
+    cmd += encode_float(exitVel)
+    cmd += encode_float(maxAccel)
+    cmd += encode_float(maxJerk)
+    cmd += encode_axes(target)
+
+    return cmd + _encode_line_times(times, speeds)
+
+
+class LineEncoder(object):
+    '''Encodes compressed line commands.
+
+    Parameters are only sent when they change and targets are sent as
+    multiples of the quantum relative to the previous target.  The AVR's
+    float32 math is replayed so the positions tracked here match its exactly.
+    reset() must be called whenever the AVR's command position or line state
+    may have changed behind our back.  A zero quantum disables compression.
+    length is the length of the last line, None if its start was unknown.'''
+
+    def __init__(self, quantum):
+        self.quantum = to_float32(quantum)
+        self.reset()
+
+
+    def reset(self):
+        self.params = {}
+        self.position = {}
+        self.target = {}
+        self.length = None
+
+
+    def invalidate(self, axis):
+        self.position.pop(axis.lower(), None)
+        self.target.pop(axis.lower(), None)
+
+
+    def _update_length(self, target):
+        length = 0
+
+        for axis in 'xyzabc':
+            value = target.get(axis, target.get(axis.upper()))
+            if value is None: continue
+
+            last = self.target.get(axis)
+            if length is not None and last is not None:
+                length += (value - last) ** 2
+            else: length = None
+
+            self.target[axis] = value
+
+        self.length = None if length is None else math.sqrt(length)
+
+
+    def line(self, target, exitVel, maxAccel, maxJerk, times, speeds):
+        self._update_length(target)
+
+        if not self.quantum:
+            return line(target, exitVel, maxAccel, maxJerk, times, speeds)
+
+        cmd = LINE_DELTA
+
+        # Sticky parameters
+        params = exitVel, maxAccel, maxJerk, self.quantum
+        for name, value in zip('VMJQ', params):
+            value = encode_float(value)
+
+            if self.params.get(name) != value:
+                self.params[name] = value
+                cmd += name + value
+
+        # Targets
+        for axis in 'xyzabc':
+            value = target.get(axis, target.get(axis.upper()))
+            if value is None: continue
+
+            last = self.position.get(axis)
+
+            if last is not None:
+                delta = int(round((value - last) / self.quantum))
+                if not delta: continue
+
+                if abs(delta) <= LINE_DELTA_MAX:
+                    delta_pos = to_float32(delta * self.quantum)
+                    self.position[axis] = to_float32(last + delta_pos)
+                    cmd += axis + encode_int(delta, LINE_DELTA_DIGITS)
+                    continue
+
+            self.position[axis] = to_float32(value)
+            cmd += axis.upper() + encode_float(value)
+
+        return cmd + _encode_line_times(times, speeds)
+
+
 def speed(value): return SPEED + encode_float(value)
 
 
@@ -127,6 +287,13 @@ def sync_speed(dist, speed):
     return SYNC_SPEED + encode_float(dist) + encode_float(speed)
 
 
+def at_speed(tolerance, timeout):
+    return AT_SPEED + encode_float(tolerance) + encode_float(timeout)
+
+
+def spindle_sync(rpm): return SPINDLE_SYNC + encode_float(rpm)
+
+
 def input(port, mode, timeout):
     type, index, m = 'd', 0, 0
 
@@ -187,7 +354,13 @@ def decode_command(cmd):
 
     data = {}
 
-    if cmd[0] == SET or cmd[0] == SET_SYNC:
+    if cmd[0] == ID:
+        i = 1
+        while i < len(cmd) and cmd[i].isdigit(): i += 1
+        data = decode_command(cmd[i:]) or {'type': 'id'}
+        data['id'] = int(cmd[1:i])
+
+    elif cmd[0] == SET or cmd[0] == SET_SYNC:
         data['type'] = 'set'
         if cmd[0] == SET_SYNC: data['sync'] = True
 
@@ -240,12 +413,47 @@ def decode_command(cmd):
             if name in 'xyzabcuvw': data['target'][name] = value
             else: data['times'][int(name)] = value
 
+    elif cmd[0] == LINE_DELTA:
+        data['type'] = 'line-delta'
+        data['target'] = {}
+        data['delta'] = {}
+        data['times'] = [0] * 7
+        params = {'V': 'exit-vel', 'M': 'max-accel', 'J': 'max-jerk',
+                  'Q': 'quantum'}
+        cmd = cmd[1:]
+
+        while len(cmd):
+            name = cmd[0]
+
+            if name in 'xyzabc':
+                data['delta'][name] = decode_int(cmd[1:4])
+                cmd = cmd[4:]
+                continue
+
+            value = decode_float(cmd[1:7])
+            cmd = cmd[7:]
+
+            if name in params: data[params[name]] = value
+            elif name in 'XYZABC': data['target'][name.lower()] = value
+            else: data['times'][int(name)] = value
+
     elif cmd[0] == SYNC_SPEED:
         data['type'] = 'speed'
         data['offset'] = decode_float(cmd[1:7])
         data['speed']  = decode_float(cmd[7:13])
 
+    elif cmd[0] == AT_SPEED:
+        data['type'] = 'at-speed'
+        data['tolerance'] = decode_float(cmd[1:7])
+        data['timeout']   = decode_float(cmd[7:13])
+
+    elif cmd[0] == SPINDLE_SYNC:
+        data['type'] = 'spindle-sync'
+        data['rpm'] = decode_float(cmd[1:7])
+
+    elif cmd[0] == CONFIG:   data['type'] = 'config'
     elif cmd[0] == REPORT:   data['type'] = 'report'
+    elif cmd[0] == SCOPE:    data['type'] = 'scope'
     elif cmd[0] == PAUSE:    data['type'] = 'pause'
     elif cmd[0] == UNPAUSE:  data['type'] = 'unpause'
     elif cmd[0] == ESTOP:    data['type'] = 'estop'
@@ -253,6 +461,8 @@ def decode_command(cmd):
     elif cmd[0] == CLEAR:    data['type'] = 'clear'
     elif cmd[0] == FLUSH:    data['type'] = 'flush'
     elif cmd[0] == RESUME:   data['type'] = 'resume'
+    elif cmd[0] == BAUD:     data['type'] = 'baud'
+    elif cmd[0] == FLOW:     data['type'] = 'flow'
 
     return data
 
@@ -27,8 +27,12 @@
 
 import serial
 import json
+import math
+import struct
 import time
+import datetime
 import traceback
+import zlib
 from collections import deque
 
 import bbctrl
@@ -49,6 +53,56 @@ DRV8711_COMM_ERROR_bm    = 1 << 8
 # Ignoring stall and stall latch flags for now
 DRV8711_MASK = ~(DRV8711_STATUS_STD_bm | DRV8711_STATUS_STDLAT_bm)
 
+# Baud rates to negotiate, fastest first
+BAUD_RATES = (1000000, 921600, 500000, 460800)
+BAUD_TIMEOUT = 1     # secs to wait for each negotiation step
+BAUD_RETRY = 2.5     # secs, AVR reverts unconfirmed rates after 2s
+BAUD_MAX_ERRORS = 4  # Serial errors per poll before falling back
+
+# Binary report frames, must be kept in sync with config.h and type.def
+REPORT_FRAME_START = 0x02
+REPORT_TYPES = {
+    '<f32>': struct.Struct('<f'),
+    '<u8>':  struct.Struct('<B'),
+    '<s8>':  struct.Struct('<b'),
+    '<u16>': struct.Struct('<H'),
+    '<s32>': struct.Struct('<i'),
+    '<u32>': struct.Struct('<I'),
+    '<b8>':  struct.Struct('<?'),
+    }
+
+# Config blobs, must be kept in sync with config.h
+CONFIG_BLOB_VERSION = 1
+CONFIG_BLOB_SIZE = 512
+CONFIG_CHUNK = 90 # Bytes per command, a multiple of 3 for base64
+
+
+def _crc16(data, crc = 0xffff):
+    for b in data:
+        crc ^= b
+        for i in range(8):
+            crc = (crc >> 1) ^ 0xa001 if crc & 1 else crc >> 1
+
+    return crc
+
+
+def _report_value(type, data, offset):
+    if type in ('<str>', '<pstr>'):
+        end = data.index(0, offset)
+        return data[offset:end].decode('utf-8'), end + 1
+
+    fmt = REPORT_TYPES[type]
+    value = fmt.unpack_from(data, offset)[0]
+    offset += fmt.size
+
+    # Match the AVR's JSON formatting
+    if type == '<f32>':
+        if math.isnan(value): value = 'nan'
+        elif math.isinf(value): value = '-inf' if value < 0 else '+inf'
+        else: value = round(value, 3)
+
+    return value, offset
+
 
 def _driver_flags_to_string(flags):
     if DRV8711_STATUS_OTS_bm    & flags: yield 'over temp'
@@ -72,9 +126,23 @@ class Comm(object):
         self.avr = avr
         self.log = self.ctrl.log.get('Comm')
         self.queue = deque()
-        self.in_buf = ''
+        self.in_buf = b''
+        self.report_vars = None
+        self.config_vars = None
+        self.config_hash = None
         self.command = None
         self.last_motor_flags = [0] * 4
+        self.scope = None
+
+        self.baud = ctrl.args.baud
+        self.baud_state = None
+        self.baud_cmd = None
+        self.baud_timeout = None
+        self.baud_errors = None
+
+        self.credit_limit = None # Unlimited until AVR advertises credits
+        self.credit_sent = 0
+        self.credit_reset = False
 
         avr.set_handlers(self._read, self._write)
         self._poll_cb(False)
@@ -101,6 +169,18 @@ class Comm(object):
     def _load_next_command(self, cmd):
         self.log.info('< ' + json.dumps(cmd).strip('"'))
         self.command = bytes(cmd.strip() + '\n', 'utf-8')
+        if cmd == Cmd.FLOW: self.credit_reset = True
+
+
+    def _credit_budget(self):
+        if self.credit_limit is None: return None
+        budget = (self.credit_limit - self.credit_sent) & 0xffff
+        return 0 if 0x8000 <= budget else budget
+
+
+    def _credit_update(self, limit):
+        self.credit_limit = limit
+        self.flush() # May have more data to send now
 
 
     def resume(self): self.queue_command(Cmd.RESUME)
@@ -114,25 +194,155 @@ class Comm(object):
     def _poll_cb(self, now = True):
         # Checks periodically for new commands from planner via comm_next()
         if now: self.flush()
+        self._baud_check()
         self.ctrl.ioloop.call_later(1, self._poll_cb)
 
 
+    def _baud_rates(self):
+        if not self.avr.can_set_baud(): return []
+        base, top = self.ctrl.args.baud, self.ctrl.args.max_baud
+        return [rate for rate in BAUD_RATES if base < rate <= top]
+
+
+    def _baud_negotiate(self):
+        self.baud_rates = self._baud_rates()
+        self._baud_next()
+
+
+    def _baud_next(self):
+        if not len(self.baud_rates): return self._baud_done()
+        self.baud_trial = self.baud_rates.pop(0)
+        self._baud_step('switch', Cmd.baud(self.baud_trial))
+
+
+    def _baud_step(self, state, cmd):
+        self._baud_cancel_timeout()
+        self.baud_state = state
+        self.baud_timeout = \
+            self.ctrl.ioloop.call_later(BAUD_TIMEOUT, self._baud_fail)
+
+        if cmd is not None:
+            self.baud_cmd = cmd
+            self.flush()
+
+
+    def _baud_cancel_timeout(self):
+        if self.baud_timeout is not None:
+            self.ctrl.ioloop.remove_timeout(self.baud_timeout)
+            self.baud_timeout = None
+
+
+    def _baud_probe(self):
+        self.baud_errors = self.avr.get_errors()
+        self._baud_step('probe', Cmd.baud_probe())
+
+
+    def _baud_msg(self, msg):
+        if self.baud_state == 'switch' and msg == 'switch':
+            # AVR switches once its reply has been sent, let the line settle
+            self.avr.set_baud(self.baud_trial)
+            self.in_buf = b''
+            self._baud_step('settle', None)
+            self.ctrl.ioloop.call_later(0.05, self._baud_probe)
+
+        elif self.baud_state == 'probe' and msg == 'ok':
+            if self.avr.get_errors() != self.baud_errors: self._baud_fail()
+            else: self._baud_step('commit', Cmd.BAUD_COMMIT)
+
+        elif self.baud_state == 'commit' and msg == 'commit':
+            self.log.info('Serial link running at %d baud' % self.baud_trial)
+            self.baud = self.baud_trial
+            self._baud_done()
+
+        else: self._baud_fail()
+
+
+    def _baud_fail(self):
+        if self.baud_state is None or self.baud_state == 'wait': return
+
+        self.log.warning('Serial link failed at %d baud' % self.baud_trial)
+        self._baud_cancel_timeout()
+        self.baud_cmd = None
+        self.baud_state = 'wait'
+        self.avr.set_baud(self.baud)
+        self.in_buf = b''
+
+        # Give the AVR time to revert to the last good rate
+        self.ctrl.ioloop.call_later(BAUD_RETRY, self._baud_next)
+
+
+    def _baud_done(self):
+        self._baud_cancel_timeout()
+        self.baud_state = None
+        self.baud_cmd = None
+
+        # Restart credit based flow control
+        self.queue_command(Cmd.FLOW)
+
+        # Resume once current queue of GCode commands has flushed
+        self.queue_command(Cmd.RESUME)
+        self.queue_command(Cmd.report_binary(False)) # Until vars are loaded
+        self.queue_command(Cmd.get('ch')) # Config restored from EEPROM
+        self.queue_command(Cmd.HELP) # Load AVR commands and variables
+
+
+    def _baud_check(self):
+        # Fall back to the default rate if the link is failing, e.g. the AVR
+        # rebooted.  The AVR also falls back when it sees receive errors.
+        if self.baud_state is not None: return
+
+        errors = self.avr.get_errors() if self.avr.can_set_baud() else None
+        last, self.baud_errors = self.baud_errors, errors
+        if errors is None or last is None or self.baud == self.ctrl.args.baud:
+            return
+
+        if BAUD_MAX_ERRORS <= errors - last:
+            self.log.warning('Serial errors at %d baud, falling back to %d' %
+                             (self.baud, self.ctrl.args.baud))
+            self.baud = self.ctrl.args.baud
+            self.avr.set_baud(self.baud)
+            self.in_buf = b''
+            self.ctrl.ioloop.call_later(BAUD_RETRY, self.connect)
+
+
     def _write(self, write_cb):
         # Finish writing current command
         if self.command is not None:
+            # Don't send more than the AVR has room for
+            data = self.command
+            budget = self._credit_budget()
+            if budget is not None:
+                if not budget:
+                    self.avr.enable_write(False) # Wait for credits
+                    return
+
+                data = data[:budget]
+
             try:
-                count = write_cb(self.command)
+                count = write_cb(data)
 
             except Exception as e:
                 self.command = None
                 raise e
 
+            self.credit_sent = (self.credit_sent + count) & 0xffff
             self.command = self.command[count:]
             if len(self.command): return # There's more
             self.command = None
 
+            # AVR counts credits from the end of the flow command
+            if self.credit_reset:
+                self.credit_reset = False
+                self.credit_sent = self.credit_limit = 0
+
+        # Only baud negotiation commands while negotiating
+        if self.baud_state is not None:
+            if self.baud_cmd is None: self.avr.enable_write(False)
+            else: self._load_next_command(self.baud_cmd)
+            self.baud_cmd = None
+
         # Load next command from queue
-        if len(self.queue): self._load_next_command(self.queue.popleft())
+        elif len(self.queue): self._load_next_command(self.queue.popleft())
 
         # Load next command from callback
         else:
@@ -144,8 +354,15 @@ class Comm(object):
 
     def _update_vars(self, msg):
         try:
+            # Report frames and config blobs index vars in the order the AVR
+            # lists them
+            self.report_vars = [(code, spec['type'], spec.get('index'))
+                                for code, spec in msg['variables'].items()]
+
             self.ctrl.state.set_machine_vars(msg['variables'])
             self.ctrl.configure()
+
+            self.queue_command(Cmd.report_binary(True))
             self.queue_command(Cmd.DUMP) # Refresh all vars
 
             # Set axis positions
@@ -158,6 +375,87 @@ class Comm(object):
             self.ctrl.ioloop.call_later(1, self.connect)
 
 
+    def config_begin(self):
+        # Collect config vars until config_end()
+        if self.report_vars is not None: self.config_vars = {}
+
+
+    def config_set(self, code, value):
+        if self.config_vars is None: return False
+        self.config_vars[code] = value
+        return True
+
+
+    def _config_entries(self, values):
+        for i, (code, type, index) in enumerate(self.report_vars):
+            if not type in REPORT_TYPES: continue
+
+            for j, label in enumerate(index or ['']):
+                name = label + code
+                if not name in values: continue
+
+                value = values[name]
+                try:
+                    if type == '<f32>': value = float(value)
+                    elif type == '<b8>': value = bool(value)
+                    else: value = int(value)
+
+                    entry = REPORT_TYPES[type].pack(value)
+
+                # Not numeric or out of range, sent as text
+                except (ValueError, TypeError, struct.error): continue
+
+                del values[name]
+                yield struct.pack('<BB', i, j) + entry
+
+
+    def _config_blob(self, data):
+        self.queue_command(Cmd.config_begin())
+
+        for i in range(0, len(data), CONFIG_CHUNK):
+            self.queue_command(Cmd.config_data(data[i:i + CONFIG_CHUNK]))
+
+        self.queue_command(Cmd.config_end(_crc16(data)))
+
+
+    def config_end(self):
+        values, self.config_vars = self.config_vars, None
+        if not values: return
+
+        # Pack vars in to as few atomically applied blobs as possible
+        blobs = []
+        data = bytes([CONFIG_BLOB_VERSION])
+
+        for entry in self._config_entries(values):
+            if CONFIG_BLOB_SIZE < len(data) + len(entry):
+                blobs.append(data)
+                data = bytes([CONFIG_BLOB_VERSION])
+
+            data += entry
+
+        if 1 < len(data): blobs.append(data)
+
+        # The hash covers the var layout too, it changes with the firmware
+        hash = zlib.crc32(json.dumps(self.report_vars).encode('utf-8'))
+        for data in blobs: hash = zlib.crc32(data, hash)
+        hash = hash or 1
+
+        # Skip the upload if the AVR restored this config from EEPROM
+        if not values and hash == self.config_hash:
+            self.log.info('AVR config unchanged')
+            return
+
+        for data in blobs: self._config_blob(data)
+
+        # Anything the AVR did not list is sent as text and not saved
+        for code, value in values.items():
+            self.queue_command('${}={}'.format(code, value))
+
+        if not values:
+            self.queue_command(Cmd.config_save(hash))
+            self.config_hash = hash
+
+
     def _log_msg(self, msg):
         level = msg.get('level', 'info')
         where = msg.get('where')
@@ -189,8 +487,45 @@ class Comm(object):
                 self.log.info('Motor %d flags: %s' % (motor, flags))
 
 
+    def _scope_msg(self, msg):
+        if isinstance(msg, dict): # Header
+            self.scope = msg
+            self.scope['data'] = []
+
+        elif isinstance(msg, list):
+            if self.scope is not None: self.scope['data'].append(msg)
+
+        elif self.scope is not None: # End
+            scope, self.scope = self.scope, None
+            self._save_scope(scope)
+
+
+    def _save_scope(self, scope):
+        ts = datetime.datetime.now().strftime('%Y-%m-%d-%H:%M:%S')
+        path = self.ctrl.get_path(filename = 'scope-%s.log' % ts)
+
+        cols = ['time', 'vel', 'accel', 'jerk']
+        cols += [axis + 'p' for axis in scope['axes']]
+        cols += ['%derror' % motor for motor in range(scope['motors'])]
+        cols += ['power', 'slack']
+
+        # Times in ms relative to the trigger sample
+        with open(path, 'w') as f:
+            f.write('# ' + ' '.join(cols) + '\n')
+
+            for i, sample in enumerate(scope['data']):
+                t = (i - scope['trigger']) * scope['period']
+                f.write(' '.join(str(x) for x in [t] + sample) + '\n')
+
+        self.log.info('Saved %d scope samples to %s', len(scope['data']), path)
+
+
     def _update_state(self, update):
         self.ctrl.state.update(update)
+        if 'ch' in update: self.config_hash = update['ch']
+
+        # Fetch the trace once the capture is complete
+        if update.get('ts') == 'done': self.queue_command(Cmd.scope_dump())
 
         if 'xx' in update:        # State change
             self.ctrl.ready()     # We've received data from AVR
@@ -199,14 +534,66 @@ class Comm(object):
         self._log_motor_flags(update)
 
 
+    def _read_frame(self):
+        # Frame: [start][length][payload][crc16]
+        if len(self.in_buf) < 2: return False
+        end = 4 + self.in_buf[1]
+        if len(self.in_buf) < end: return False
+
+        frame = self.in_buf[:end]
+        crc = frame[-2] | frame[-1] << 8
+
+        if _crc16(frame[1:-2]) != crc:
+            self.log.warning('Report frame CRC error')
+            self.in_buf = self.in_buf[1:] # Resync
+            return True
+
+        self.in_buf = self.in_buf[end:]
+        if self.report_vars is None: return True # Not loaded yet
+
+        update = {}
+        data, offset = frame[2:-2], 0
+
+        try:
+            while offset < len(data):
+                code, type, index = self.report_vars[data[offset]]
+                offset += 1
+
+                if index is not None:
+                    code = index[data[offset]] + code
+                    offset += 1
+
+                update[code], offset = _report_value(type, data, offset)
+
+        except Exception as e:
+            self.log.warning('Invalid report frame: %s', e)
+            return True
+
+        self.log.info('> ' + json.dumps(update))
+        self._update_state(update)
+
+        return True
+
+
     def _read(self, data):
-        self.in_buf += data.decode('utf-8')
+        self.in_buf += data
 
-        # Parse incoming serial data into lines
-        while True:
-            i = self.in_buf.find('\n')
+        # Parse incoming serial data into lines and binary report frames
+        while len(self.in_buf):
+            if self.in_buf[0] == REPORT_FRAME_START:
+                if self._read_frame(): continue
+                break
+
+            i = self.in_buf.find(b'\n')
             if i == -1: break
-            line = self.in_buf[0:i].strip()
+
+            # Drop partial text before a frame
+            start = self.in_buf.find(bytes([REPORT_FRAME_START]), 0, i)
+            if start != -1:
+                self.in_buf = self.in_buf[start:]
+                continue
+
+            line = self.in_buf[0:i].decode('utf-8', 'replace').strip()
             self.in_buf = self.in_buf[i + 1:]
 
             if line:
@@ -220,7 +607,10 @@ class Comm(object):
                     continue
 
                 if 'variables' in msg: self._update_vars(msg)
+                elif 'credit' in msg: self._credit_update(msg['credit'])
+                elif 'baud' in msg: self._baud_msg(msg['baud'])
                 elif 'msg' in msg: self._log_msg(msg)
+                elif 'scope' in msg: self._scope_msg(msg['scope'])
 
                 elif 'firmware' in msg:
                     self.log.info('AVR firmware rebooted')
@@ -248,9 +638,18 @@ class Comm(object):
 
     def connect(self):
         try:
-            # Resume once current queue of GCode commands has flushed
-            self.queue_command(Cmd.RESUME)
-            self.queue_command(Cmd.HELP) # Load AVR commands and variables
+            # Text reports until the AVR's vars are loaded again
+            self.report_vars = None
+            self.config_hash = None
+
+            # No credits until the AVR advertises them again
+            self.credit_limit = None
+            self.credit_reset = False
+
+            # Negotiate a faster link if possible then resume and load vars
+            if self.baud_state is None:
+                if self.baud == self.ctrl.args.baud: self._baud_negotiate()
+                else: self._baud_done()
 
         except Exception as e:
             self.log.warning('Connect failed: %s', e)
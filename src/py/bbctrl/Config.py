@@ -241,9 +241,15 @@ class Config(object):
 
 
     def _update(self, config, with_defaults):
-        for name, tmpl in self.template.items():
-            conf = config.get(name, None)
-            self._encode(name, '', conf, tmpl, with_defaults)
+        # Batch AVR vars in to config blobs
+        self.ctrl.mach.config_begin()
+
+        try:
+            for name, tmpl in self.template.items():
+                conf = config.get(name, None)
+                self._encode(name, '', conf, tmpl, with_defaults)
+
+        finally: self.ctrl.mach.config_end()
 
 
     def reload(self): self._update(self.load(), True)
@@ -240,7 +240,8 @@ class Mach(Comm):
 
 
     def set(self, code, value):
-        super().queue_command('${}={}'.format(code, value))
+        if not super().config_set(code, value):
+            super().queue_command('${}={}'.format(code, value))
 
 
     def jog(self, axes):
@@ -357,6 +358,10 @@ class Mach(Comm):
         self._i2c_block(Cmd.modbus_write(addr, value))
 
 
+    def scope_arm(self, axes, trigger, arg = None):
+        super().queue_command(Cmd.scope_arm(axes, trigger, arg))
+
+
     def macro(self, macro):
         macros = self.ctrl.config.get('macros')
         if len(macros) < macro: raise Exception('Invalid macro id %d' % macro)
@@ -64,6 +64,7 @@ class Planner():
         self.ctrl = ctrl
         self.log = ctrl.log.get('Planner')
         self.cmdq = CommandQueue(ctrl)
+        self.lines = Cmd.LineEncoder(ctrl.args.line_quantum)
         self.planner = None
         self._position_dirty = False
         self.where = ''
@@ -248,6 +249,15 @@ class Planner():
         self.plan_time += block['seconds']
 
 
+    def _at_speed(self, speed):
+        # Hold motion until the spindle reaches the new speed
+        tolerance = self.ctrl.config.get('at-speed-tolerance', 0)
+        if not speed or not tolerance: return ''
+
+        timeout = self.ctrl.config.get('at-speed-timeout', 0)
+        return '\n' + Cmd.at_speed(tolerance / 100, timeout)
+
+
     def __encode(self, block):
         type, id = block['type'], block['id']
 
@@ -257,9 +267,19 @@ class Planner():
 
         if type == 'line':
             self._enqueue_line_time(block)
-            return Cmd.line(block['target'], block['exit-vel'],
-                            block['max-accel'], block['max-jerk'],
-                            block['times'], block.get('speeds', []))
+            speeds = block.get('speeds', [])
+            cmd = self.lines.line(block['target'], block['exit-vel'],
+                                  block['max-accel'], block['max-jerk'],
+                                  block['times'], speeds)
+
+            # Hold motion after a speed change at the end of the line.  Not
+            # possible when the line's start is unknown, e.g. after a seek.
+            length = self.lines.length
+            if speeds and length is not None:
+                dist, speed = speeds[-1]
+                if length <= dist + 1e-3: cmd += self._at_speed(speed)
+
+            return cmd
 
         if type == 'set':
             name, value = block['name'], block['value']
@@ -271,7 +291,7 @@ class Planner():
 
             if name == 'speed':
                 self._enqueue_set_cmd(id, name, value)
-                return Cmd.speed(value)
+                return Cmd.speed(value) + self._at_speed(value)
 
             if len(name) and name[0] == '_':
                 # Don't queue axis positions, can be triggered by new position
@@ -282,7 +302,9 @@ class Planner():
                 return Cmd.set_sync('if', 1 / value if value else 0)
 
             if name[0:1] == '_' and name[1:2] in 'xyzabc':
-                if name[2:] == '_home': return Cmd.set_axis(name[1], value)
+                if name[2:] == '_home':
+                    self.lines.invalidate(name[1])
+                    return Cmd.set_axis(name[1], value)
 
                 if name[2:] == '_homed':
                     motor = self.ctrl.state.find_motor(name[1])
@@ -294,6 +316,7 @@ class Planner():
         if type == 'input':
             # TODO handle timeout
             self.planner.synchronize(0) # TODO Fix this
+            self.lines.reset()
             return Cmd.input(block['port'], block['mode'], block['timeout'])
 
         if type == 'output':
@@ -307,6 +330,7 @@ class Planner():
 
         if type == 'seek':
             sw = self.ctrl.state.get_switch_id(block['switch'])
+            self.lines.reset() # Seek ends at an unknown position
             return Cmd.seek(sw, block['active'], block['error'])
 
         if type == 'end':
@@ -321,7 +345,7 @@ class Planner():
 
         if cmd is not None:
             self.cmdq.enqueue(block['id'], None)
-            return Cmd.set_sync('id', block['id']) + '\n' + cmd
+            return Cmd.with_id(block['id'], cmd)
 
 
     def reset_times(self):
@@ -346,6 +370,7 @@ class Planner():
         # TODO logger is global and will not work correctly in demo mode
         camotics.set_logger(self._log_cb, 1, 'LinePlanner:3')
         self._position_dirty = True
+        self.lines.reset()
         self.cmdq.clear()
         self.reset_times()
         self.ctrl.state.reset()
@@ -355,6 +380,7 @@ class Planner():
         self.where = '<mdi>'
         self.log.info('MDI:' + cmd)
         self._sync_position()
+        self.lines.reset()
         self.planner.load_string(cmd, self.get_config(True, with_limits))
         self.reset_times()
 
@@ -377,6 +403,7 @@ class Planner():
         self.log.info('GCode:' + path)
         self._log_time('Program Start: ')
         self._sync_position()
+        self.lines.reset()
         self.planner.load(path, self.get_config(False, True))
         self.reset_times()
 
@@ -384,6 +411,7 @@ class Planner():
     def stop(self):
         try:
             self.planner.stop()
+            self.lines.reset()
             self.cmdq.clear()
             self._end_program('Program Stop: ')
 
@@ -399,6 +427,7 @@ class Planner():
 
             self.log.info('Planner restart: %d %s' % (id, log_json(position)))
 
+            self.lines.reset()
             self.cmdq.clear()
             self.cmdq.release(id)
             self._plan_time_restart()
@@ -448,6 +448,14 @@ class ModbusWriteHandler(bbctrl.APIHandler):
                                     int(self.json['value']))
 
 
+class ScopeArmHandler(bbctrl.APIHandler):
+    def put_ok(self):
+        arg = self.json.get('arg')
+        self.get_ctrl().mach.scope_arm(self.json.get('axes', 'xy'),
+                                       self.json.get('trigger', 'n'),
+                                       None if arg is None else int(arg))
+
+
 class JogHandler(bbctrl.APIHandler):
     def put_ok(self):
         # Handle possible out of order jog command processing
@@ -603,6 +611,7 @@ class Web(tornado.web.Application):
             (r'/api/override/speed/([\d.]+)', OverrideSpeedHandler),
             (r'/api/modbus/read', ModbusReadHandler),
             (r'/api/modbus/write', ModbusWriteHandler),
+            (r'/api/scope/arm', ScopeArmHandler),
             (r'/api/jog', JogHandler),
             (r'/api/video', bbctrl.VideoHandler),
             (r'/(.*)', StaticFileHandler,
@@ -137,6 +137,11 @@ def parse_args():
                         help = 'Serial device')
     parser.add_argument('-b', '--baud', default = 230400, type = int,
                         help = 'Serial baud rate')
+    parser.add_argument('--max-baud', default = 1000000, type = int,
+                        help = 'Highest serial baud rate to negotiate')
+    parser.add_argument('--line-quantum', default = 0.001, type = float,
+                        help = 'Resolution of delta coded moves in mm, 0 to '
+                        'disable')
     parser.add_argument('--i2c-port', default = 1, type = int,
                         help = 'I2C port')
     parser.add_argument('--lcd-addr', default = [0x27, 0x3f], type = int,
@@ -165,6 +170,9 @@ def parse_args():
                         help = 'Enable debug mode and set frequency in seconds')
     parser.add_argument('--fast-emu', action = 'store_true',
                         help = 'Enter demo mode')
+    parser.add_argument('--emu-vfd',
+                        help = 'Attach an emulated VFD to the emulator, one of '
+                        'ac-tech, nowforever, delta, yl600 or huanyang')
     parser.add_argument('--client-timeout', default = 5 * 60, type = int,
                         help = 'Demo client timeout in seconds')
 